@@ -25,6 +25,13 @@
 
 #define CppExport extern "C" attribute_visible
 
+SEXP jetbrains_ther_device_snapshot_cache_statistics();
+CppExport SEXP _rplugingraphics_jetbrains_ther_device_snapshot_cache_statistics() {
+  CPP_BEGIN
+    return jetbrains_ther_device_snapshot_cache_statistics();
+  CPP_END
+}
+
 SEXP jetbrains_ther_device_record(bool isTriggeredByGgPlot);
 CppExport SEXP _rplugingraphics_jetbrains_ther_device_record(SEXP isTriggeredByGgPlotSEXP) {
   CPP_BEGIN
@@ -121,6 +128,14 @@ CppExport SEXP _jetbrains_debugger_disable() {
   CPP_END
 }
 
+CppExport SEXP _jetbrains_debugger_setBreakpointHitPolicy(SEXP id, SEXP hitNumber, SEXP hitModulo, SEXP firstHits,
+                                                          SEXP maxLogsPerSecond) {
+  CPP_BEGIN
+    rDebugger.setBreakpointHitPolicy(asInt(id), asInt(hitNumber), asInt(hitModulo), asInt(firstHits),
+                                     asInt(maxLogsPerSecond));
+  CPP_END
+}
+
 CppExport SEXP _jetbrains_exception_handler(SEXP e) {
   CPP_BEGIN
     rDebugger.doHandleException(e);
@@ -348,6 +363,7 @@ static const R_CallMethodDef CallEntries[] = {
     {".jetbrains_ther_device_record", (DL_FUNC) &_rplugingraphics_jetbrains_ther_device_record, 1},
     {".jetbrains_ther_device_restart", (DL_FUNC) &_rplugingraphics_jetbrains_ther_device_restart, 0},
     {".jetbrains_ther_device_snapshot_count", (DL_FUNC) &_rplugingraphics_jetbrains_ther_device_snapshot_count, 0},
+    {".jetbrains_ther_device_snapshot_cache_statistics", (DL_FUNC) &_rplugingraphics_jetbrains_ther_device_snapshot_cache_statistics, 0},
     {"_rplugingraphics_rs_base64encode", (DL_FUNC) &_rplugingraphics_rs_base64encode, 2},
     {"_rplugingraphics_rs_base64decode", (DL_FUNC) &_rplugingraphics_rs_base64decode, 2},
     {".jetbrains_ther_device_init", (DL_FUNC) &_rplugingraphics_jetbrains_ther_device_init, 5},
@@ -357,6 +373,7 @@ static const R_CallMethodDef CallEntries[] = {
     {".jetbrains_View", (DL_FUNC) &_jetbrains_View, 3},
     {".jetbrains_debugger_enable", (DL_FUNC) &_jetbrains_debugger_enable, 0},
     {".jetbrains_debugger_disable", (DL_FUNC) &_jetbrains_debugger_disable, 0},
+    {".jetbrains_debugger_setBreakpointHitPolicy", (DL_FUNC) &_jetbrains_debugger_setBreakpointHitPolicy, 5},
     {".jetbrains_exception_handler", (DL_FUNC) &_jetbrains_exception_handler, 1},
     {".jetbrains_quitRWrapper", (DL_FUNC) &_jetbrains_quitRWrapper, 0},
     {".jetbrains_showFile", (DL_FUNC) &_jetbrains_showFile, 2},
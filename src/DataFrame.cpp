@@ -20,6 +20,7 @@
 #include "IO.h"
 #include "RStuff/RUtil.h"
 #include "DataFrame.h"
+#include "RStuff/Fingerprint.h"
 
 const char* ROW_NAMES_COL = "rwr_rownames_column";
 
@@ -42,13 +43,13 @@ static PrSEXP& getDataFrameStorageEnv() {
   return env;
 }
 
-static std::vector<SEXP> getEqualityVector(SEXP _x) {
+static std::vector<uint64_t> getEqualityVector(SEXP _x) {
   ShieldSEXP x = _x;
-  std::vector<SEXP> v = {x};
-  v.push_back(Rf_getAttrib(x, Rf_install("names")));
-  v.push_back(Rf_getAttrib(x, Rf_install("rownames")));
+  std::vector<uint64_t> v = {getFingerprint(x, 0)};
+  v.push_back(getFingerprint(Rf_getAttrib(x, Rf_install("names"))));
+  v.push_back(getFingerprint(Rf_getAttrib(x, Rf_install("rownames"))));
   if (x.type() == VECSXP) {
-    for (int i = 0; i < x.length(); ++i) v.push_back(x[i]);
+    for (int i = 0; i < x.length(); ++i) v.push_back(getFingerprint(VECTOR_ELT(x, i)));
   }
   return v;
 }
@@ -19,13 +19,14 @@
 
 #include "RStuff/RInclude.h"
 #include "RStuff/MySEXP.h"
+#include <cstdint>
 #include <functional>
 
 struct DataFrameInfo {
   int refIndex;
   int uniqueIndex;
   PrSEXP initialDataFrame;
-  std::vector<SEXP> equalityVector;
+  std::vector<uint64_t> equalityVector;
   PrSEXP dataFrame;
   std::function<SEXP()> refresher;
   std::function<void()> finalizer;
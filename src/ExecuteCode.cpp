@@ -109,6 +109,7 @@ Status RPIServiceImpl::executeCode(ServerContext* context, const ExecuteCodeRequ
           } else if (firstDebugCommand == ExecuteCodeRequest_DebugCommand_STOP) {
             rDebugger.setCommand(STEP_INTO);
           }
+          rDebugger.updateBytecode();
         }
       }
       PrSEXP expressions;
@@ -149,6 +150,7 @@ Status RPIServiceImpl::executeCode(ServerContext* context, const ExecuteCodeRequ
       }
     } catch (RJumpToToplevelException const&) {
     }
+    rDebugger.flushLogpoints();
     if (disableBytecode) RDebugger::setBytecodeEnabled(true);
   }, context);
   return Status::OK;
@@ -168,6 +170,7 @@ std::string RPIServiceImpl::readLineHandler(std::string const& prompt) {
 
 void RPIServiceImpl::debugPromptHandler() {
   if (replState != REPL_BUSY) return;
+  invalidateDereferenceCache();
   AsyncEvent event;
   rDebugger.buildDebugPrompt(event.mutable_debugprompt());
   asyncEvents.push(event);
@@ -293,6 +296,7 @@ static void executeCodeImpl(SEXP _exprs, SEXP _env, bool withEcho, bool isDebug,
         value = rDebugger.doStep(expr, env, R_Srcref);
         visible = *ptr_R_Visible;
         rDebugger.disable();
+        rDebugger.flushLogpoints();
       } else {
         value = Rf_eval(expr, env);
         visible = *ptr_R_Visible;
@@ -64,6 +64,7 @@ void quitRWrapper() {
   quitRPIService();
   quitEventLoop();
   RI = nullptr;
+  protectionTable::reportLeaks();
 }
 
 extern "C" {
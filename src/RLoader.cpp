@@ -203,36 +203,37 @@ Status RPIServiceImpl::loaderGetVariables(ServerContext* context, const GetVaria
     if (obj.type() == ENVSXP) {
       response->set_isenv(true);
       if (request->onlyfunctions() && request->nofunctions()) return;
-      ShieldSEXP ls = RI->ls(named("envir", obj), named("all.names", !request->nohidden()));
-      if (ls.type() != STRSXP) return;
-      R_xlen_t length = ls.length();
-      if (request->onlyfunctions() || request->nofunctions()) {
-        R_xlen_t j = 0;
-        for (R_xlen_t i = 0; i < length; ++i) {
-          ShieldSEXP x = obj.getVar(stringEltNative(ls, i), false);
+      // Note: variables are shown sorted, but listing itself doesn't force promises or active bindings
+      std::vector<SEXP> symbols = getBindingSymbols(obj, !request->nohidden(), "", true);
+      bool filterFunctions = request->onlyfunctions() || request->nofunctions();
+      R_xlen_t j = 0;
+      for (SEXP symbol : symbols) {
+        if (!filterFunctions && (j < reqStart || j >= reqEnd)) {
+          ++j;
+          continue;
+        }
+        EnvBinding binding = getBinding(obj, symbol);
+        ShieldSEXP x = binding.value;
+        if (filterFunctions) {
           bool isFunc = x.type() == CLOSXP || x.type() == BUILTINSXP || x.type() == SPECIALSXP;
-          if (isFunc == request->onlyfunctions()) {
-            if (reqStart <= j && j < reqEnd) {
-              VariablesResponse::Variable *var = response->add_vars();
-              std::string name = stringEltUTF8(ls, i);
-              trim(name);
-              var->set_name(name);
-              getValueInfo(x, var->mutable_value());
-            }
-            ++j;
-          }
+          if (isFunc != request->onlyfunctions()) continue;
         }
-        response->set_totalcount(j);
-      } else {
-        response->set_totalcount(ls.length());
-        for (int i = std::max<R_xlen_t>(0, reqStart); i < std::min(length, reqEnd); ++i) {
+        if (reqStart <= j && j < reqEnd) {
           VariablesResponse::Variable *var = response->add_vars();
-          std::string name = stringEltUTF8(ls, i);
+          std::string name = Rf_translateCharUTF8(PRINTNAME(symbol));
           trim(name);
           var->set_name(name);
-          getValueInfo(obj.getVar(stringEltNative(ls, i), false), var->mutable_value());
+          if (binding.kind == BindingKind::ACTIVE) {
+            var->mutable_value()->mutable_value()->set_isvector(false);
+            var->mutable_value()->mutable_value()->set_textvalue("<active binding>");
+            var->mutable_value()->mutable_value()->set_iscomplete(true);
+          } else {
+            getValueInfo(x, var->mutable_value());
+          }
         }
+        ++j;
       }
+      response->set_totalcount(j);
       return;
     }
     response->set_isenv(false);
@@ -27,6 +27,9 @@
 #include "graphics/DeviceManager.h"
 #include "graphics/SnapshotUtil.h"
 #include "graphics/Evaluator.h"
+#include "graphics/PixelUtil.h"
+#include "graphics/RescaleWorkerPool.h"
+#include "graphics/SnapshotCache.h"
 #include "graphics/figures/CircleFigure.h"
 #include "graphics/figures/LineFigure.h"
 #include "graphics/figures/PathFigure.h"
@@ -101,12 +104,7 @@ namespace {
 
   // Note: returns an empty string if a snapshot cannot be found
   std::string getStoredSnapshotName(const std::string& directory, int number) {
-    auto sout = std::ostringstream();
-    sout << ".jetbrains$findStoredSnapshot('" << escapeStringCharacters(directory) << "', " << number << ")";
-    auto command = sout.str();
-    graphics::ScopeProtector protector;
-    auto nameSEXP = graphics::Evaluator::evaluate(command, &protector);
-    return std::string(stringEltUTF8(nameSEXP, 0));
+    return graphics::SnapshotUtil::findStoredSnapshotName(directory, number);
   }
 
   std::string getChunkOutputFullPath(const std::string& relativePath) {
@@ -223,73 +221,70 @@ namespace {
   }
 
   void fillMessage(rplugininterop::Polyline* message, const graphics::Polyline& polyline) {
-    auto pointCount = polyline.points.size();
-    for (auto i = 0U; i < pointCount; i++) {
-      message->add_point(packPoint(polyline.points[i], polyline.previewMask[i]));
+    // Note: points are packed straight into the preallocated storage of the repeated field
+    // instead of being appended one by one
+    auto pointCount = int(polyline.points.size());
+    auto points = message->mutable_point();
+    points->Resize(pointCount, 0U);
+    auto data = points->mutable_data();
+    for (auto i = 0; i < pointCount; i++) {
+      data[i] = packPoint(polyline.points[i], polyline.previewMask[i]);
     }
     message->set_previewcount(polyline.previewCount);
   }
 
-  rplugininterop::Polyline* createMessage(const graphics::Polyline& polyline) {
-    auto message = new rplugininterop::Polyline();
-    fillMessage(message, polyline);
-    return message;
-  }
-
-  RasterImage* createMessage(const graphics::RasterImage& image) {
-    auto message = new RasterImage();
+  void fillMessage(RasterImage* message, const graphics::RasterImage& image) {
     message->set_width(image.width);
     message->set_height(image.height);
-    message->set_data(image.data.get(), image.width * image.height * sizeof(uint32_t));
-    return message;
+    // Note: pixels are converted straight into the message's buffer in order to avoid an extra copy
+    auto pixelCount = image.width * image.height;
+    auto data = message->mutable_data();
+    data->resize(pixelCount * sizeof(uint32_t));
+    if (pixelCount > 0) {
+      graphics::PixelUtil::convertAbgrToArgb(image.data.get(), reinterpret_cast<uint8_t*>(&(*data)[0]), pixelCount);
+    }
   }
 
-  FixedViewport* createMessage(const graphics::FixedViewport& viewport) {
-    auto message = new FixedViewport();
+  void fillMessage(FixedViewport* message, const graphics::FixedViewport& viewport) {
     message->set_ratio(viewport.getRatio());
     message->set_delta(viewport.getDelta());
     message->set_parentindex(viewport.getParentIndex());
-    return message;
   }
 
-  FreeViewport* createMessage(const graphics::FreeViewport& viewport) {
-    auto message = new FreeViewport();
+  void fillMessage(FreeViewport* message, const graphics::FreeViewport& viewport) {
     message->set_from(packPoint(viewport.getFrom()));
     message->set_to(packPoint(viewport.getTo()));
     message->set_parentindex(viewport.getParentIndex());
-    return message;
   }
 
   void fillMessage(Viewport* message, const graphics::Viewport& viewport) {
+    // Note: `isFixed()` already tells the exact type, so there is no need for `dynamic_cast`
     if (viewport.isFixed()) {
-      message->set_allocated_fixed(createMessage(dynamic_cast<const graphics::FixedViewport&>(viewport)));
+      fillMessage(message->mutable_fixed(), static_cast<const graphics::FixedViewport&>(viewport));
     } else {
-      message->set_allocated_free(createMessage(dynamic_cast<const graphics::FreeViewport&>(viewport)));
+      fillMessage(message->mutable_free(), static_cast<const graphics::FreeViewport&>(viewport));
     }
   }
 
-  CircleFigure* createMessage(const graphics::CircleFigure& circle) {
-    auto message = new CircleFigure();
+  void fillMessage(CircleFigure* message, const graphics::CircleFigure& circle) {
     message->set_center(packPoint(circle.getCenter(), circle.isMasked()));
     message->set_radius(packCoordinate(circle.getRadius()));
     message->set_strokeindex(circle.getStrokeIndex());
     message->set_colorindex(circle.getColorIndex());
     message->set_fillindex(circle.getFillIndex());
-    return message;
   }
 
-  LineFigure* createMessage(const graphics::LineFigure& line) {
-    auto message = new LineFigure();
+  void fillMessage(LineFigure* message, const graphics::LineFigure& line) {
     message->set_from(packPoint(line.getFrom()));
     message->set_to(packPoint(line.getTo()));
     message->set_strokeindex(line.getStrokeIndex());
     message->set_colorindex(line.getColorIndex());
-    return message;
   }
 
-  PathFigure* createMessage(const graphics::PathFigure& path) {
-    auto message = new PathFigure();
-    for (const auto& subPath : path.getSubPaths()) {
+  void fillMessage(PathFigure* message, const graphics::PathFigure& path) {
+    const auto& subPaths = path.getSubPaths();
+    message->mutable_subpath()->Reserve(int(subPaths.size()));
+    for (const auto& subPath : subPaths) {
       auto subPathMessage = message->add_subpath();
       fillMessage(subPathMessage, subPath);
     }
@@ -297,94 +292,84 @@ namespace {
     message->set_strokeindex(path.getStrokeIndex());
     message->set_colorindex(path.getColorIndex());
     message->set_fillindex(path.getFillIndex());
-    return message;
   }
 
-  PolygonFigure* createMessage(const graphics::PolygonFigure& polygon) {
-    auto message = new PolygonFigure();
-    message->set_allocated_polyline(createMessage(polygon.getPolyline()));
+  void fillMessage(PolygonFigure* message, const graphics::PolygonFigure& polygon) {
+    fillMessage(message->mutable_polyline(), polygon.getPolyline());
     message->set_strokeindex(polygon.getStrokeIndex());
     message->set_colorindex(polygon.getColorIndex());
     message->set_fillindex(polygon.getFillIndex());
-    return message;
   }
 
-  PolylineFigure* createMessage(const graphics::PolylineFigure& polyline) {
-    auto message = new PolylineFigure();
-    message->set_allocated_polyline(createMessage(polyline.getPolyline()));
+  void fillMessage(PolylineFigure* message, const graphics::PolylineFigure& polyline) {
+    fillMessage(message->mutable_polyline(), polyline.getPolyline());
     message->set_strokeindex(polyline.getStrokeIndex());
     message->set_colorindex(polyline.getColorIndex());
-    return message;
   }
 
-  RasterFigure* createMessage(const graphics::RasterFigure& raster) {
-    auto message = new RasterFigure();
-    message->set_allocated_image(createMessage(raster.getImage()));
+  void fillMessage(RasterFigure* message, const graphics::RasterFigure& raster) {
+    fillMessage(message->mutable_image(), raster.getImage());
     message->set_from(packPoint(raster.getFrom()));
     message->set_to(packPoint(raster.getTo()));
     message->set_interpolate(raster.getInterpolate());
     message->set_angle(raster.getAngle());
-    return message;
   }
 
-  RectangleFigure* createMessage(const graphics::RectangleFigure& rectangle) {
-    auto message = new RectangleFigure();
+  void fillMessage(RectangleFigure* message, const graphics::RectangleFigure& rectangle) {
     message->set_from(packPoint(rectangle.getFrom()));
     message->set_to(packPoint(rectangle.getTo()));
     message->set_strokeindex(rectangle.getStrokeIndex());
     message->set_colorindex(rectangle.getColorIndex());
     message->set_fillindex(rectangle.getFillIndex());
-    return message;
   }
 
-  TextFigure* createMessage(const graphics::TextFigure& text) {
-    auto message = new TextFigure();
+  void fillMessage(TextFigure* message, const graphics::TextFigure& text) {
     message->set_text(text.getText());
     message->set_position(packPoint(text.getPosition()));
     message->set_angle(text.getAngle());
     message->set_anchor(text.getAnchor());
     message->set_fontindex(text.getFontIndex());
     message->set_colorindex(text.getColorIndex());
-    return message;
   }
 
-  template<typename TFigure>
-  auto createMessage(const graphics::Figure& figure) {
-    return createMessage(dynamic_cast<const TFigure&>(figure));
+  template<typename TFigure, typename TMessage>
+  void fillMessage(TMessage* message, const graphics::Figure& figure) {
+    // Note: the kind of figure already tells its exact type, so there is no need for `dynamic_cast`
+    fillMessage(message, static_cast<const TFigure&>(figure));
   }
 
   void fillMessage(Figure* message, const graphics::Figure& figure) {
     switch (figure.getKind()) {
       case graphics::FigureKind::CIRCLE: {
-        message->set_allocated_circle(createMessage<graphics::CircleFigure>(figure));
+        fillMessage<graphics::CircleFigure>(message->mutable_circle(), figure);
         break;
       }
       case graphics::FigureKind::LINE: {
-        message->set_allocated_line(createMessage<graphics::LineFigure>(figure));
+        fillMessage<graphics::LineFigure>(message->mutable_line(), figure);
         break;
       }
       case graphics::FigureKind::PATH: {
-        message->set_allocated_path(createMessage<graphics::PathFigure>(figure));
+        fillMessage<graphics::PathFigure>(message->mutable_path(), figure);
         break;
       }
       case graphics::FigureKind::POLYGON: {
-        message->set_allocated_polygon(createMessage<graphics::PolygonFigure>(figure));
+        fillMessage<graphics::PolygonFigure>(message->mutable_polygon(), figure);
         break;
       }
       case graphics::FigureKind::POLYLINE: {
-        message->set_allocated_polyline(createMessage<graphics::PolylineFigure>(figure));
+        fillMessage<graphics::PolylineFigure>(message->mutable_polyline(), figure);
         break;
       }
       case graphics::FigureKind::RASTER: {
-        message->set_allocated_raster(createMessage<graphics::RasterFigure>(figure));
+        fillMessage<graphics::RasterFigure>(message->mutable_raster(), figure);
         break;
       }
       case graphics::FigureKind::RECTANGLE: {
-        message->set_allocated_rectangle(createMessage<graphics::RectangleFigure>(figure));
+        fillMessage<graphics::RectangleFigure>(message->mutable_rectangle(), figure);
         break;
       }
       case graphics::FigureKind::TEXT: {
-        message->set_allocated_text(createMessage<graphics::TextFigure>(figure));
+        fillMessage<graphics::TextFigure>(message->mutable_text(), figure);
         break;
       }
     }
@@ -394,29 +379,34 @@ namespace {
     message->set_clippingareaindex(layer.clippingAreaIndex);
     message->set_viewportindex(layer.viewportIndex);
     message->set_isaxistext(layer.isAxisText);
+    message->mutable_figure()->Reserve(int(layer.figures.size()));
     for (const auto& figure : layer.figures) {
       auto figureMessage = message->add_figure();
       fillMessage(figureMessage, *figure);
     }
   }
 
-  Plot* createMessage(const graphics::Plot& plot) {
-    auto message = new Plot();
+  void fillMessage(Plot* message, const graphics::Plot& plot) {
+    message->mutable_font()->Reserve(int(plot.fonts.size()));
     for (const auto& font : plot.fonts) {
       auto fontMessage = message->add_font();
       fillMessage(fontMessage, font);
     }
+    message->mutable_color()->Reserve(int(plot.colors.size()));
     for (const auto& color : plot.colors) {
       message->add_color(color.value);
     }
+    message->mutable_stroke()->Reserve(int(plot.strokes.size()));
     for (const auto& stroke : plot.strokes) {
       auto strokeMessage = message->add_stroke();
       fillMessage(strokeMessage, stroke);
     }
+    message->mutable_viewport()->Reserve(int(plot.viewports.size()));
     for (const auto& viewport : plot.viewports) {
       auto viewportMessage = message->add_viewport();
       fillMessage(viewportMessage, *viewport);
     }
+    message->mutable_layer()->Reserve(int(plot.layers.size()));
     for (const auto& layer : plot.layers) {
       auto layerMessage = message->add_layer();
       fillMessage(layerMessage, layer);
@@ -424,7 +414,6 @@ namespace {
     message->set_previewcomplexity(plot.previewComplexity);
     message->set_totalcomplexity(plot.totalComplexity);
     message->set_error(int(plot.error));
-    return message;
   }
 }
 
@@ -496,6 +485,46 @@ Status RPIServiceImpl::graphicsRescale(ServerContext* context, const GraphicsRes
 }
 
 Status RPIServiceImpl::graphicsRescaleStored(ServerContext* context, const GraphicsRescaleStoredRequest* request, ServerWriter<CommandOutput>* writer) {
+  auto pool = graphics::RescaleWorkerPool::getInstance();
+  if (pool->isSupported()) {
+    auto directory = request->groupid();
+    auto number = request->snapshotnumber();
+    auto size = graphics::Size{double(request->newparameters().width()), double(request->newparameters().height())};
+    auto parameters = graphics::ScreenParameters{size, request->newparameters().resolution()};
+    // Note: the cache doesn't depend on R, so a hit needs neither the main thread nor a worker
+    auto cache = graphics::SnapshotCache::getInstance(directory);
+    auto cacheKey = graphics::SnapshotKey::make(number, graphics::SnapshotType::NORMAL, parameters);
+    auto name = graphics::SnapshotUtil::makeSnapshotName(number, request->snapshotversion() + 1, parameters.resolution);
+    auto path = directory + "/" + name;
+    auto result = cache->restore(cacheKey, path) ? graphics::RescaleWorkerPool::Result::SUCCEEDED
+                                                 : graphics::RescaleWorkerPool::Result::FAILED;
+    if (result != graphics::RescaleWorkerPool::Result::SUCCEEDED) {
+      auto key = directory + "/" + std::to_string(number);
+      result = pool->run(key, [&] {
+        auto pid = -1;
+        executeOnMainThread([&] {
+          auto active = graphics::DeviceManager::getInstance()->getActive();
+          if (active) {
+            pid = active->launchRescaleByPath(directory, number, request->snapshotversion(), parameters);
+          }
+        }, context);
+        return pid;
+      });
+      if (result == graphics::RescaleWorkerPool::Result::SUCCEEDED) {
+        cache->put(cacheKey, path);
+      }
+    }
+    // Note: if the worker has failed (say, it has been stuck and killed),
+    // the plot is rescaled synchronously below
+    if (result != graphics::RescaleWorkerPool::Result::FAILED) {
+      // Note: mimic the output of the synchronous `.Call()` below
+      CommandOutput response;
+      response.set_type(CommandOutput::STDOUT);
+      response.set_text(result == graphics::RescaleWorkerPool::Result::SUCCEEDED ? "[1] TRUE\n" : "[1] FALSE\n");
+      writer->Write(response);
+      return Status::OK;
+    }
+  }
   auto strings = std::vector<std::string> {
     ".jetbrains_ther_device_rescale_stored",
     request->groupid(),
@@ -558,7 +587,7 @@ Status RPIServiceImpl::graphicsFetchPlot(ServerContext* context, const Int32Valu
     try {
       auto active = getActiveDeviceOrThrow();
       auto plot = active->fetchPlot(request->value());
-      response->set_allocated_plot(createMessage(plot));
+      fillMessage(response->mutable_plot(), plot);
     } catch (const std::exception& e) {
       response->set_message(e.what());
     }
@@ -691,6 +720,7 @@ void RPIServiceImpl::mainLoop() {
     RDebugger::setBytecodeEnabled(true);
     rDebugger.disable();
     rDebugger.clearSavedStack();
+    invalidateDereferenceCache();
     if (replState != PROMPT) {
       event.mutable_prompt();
       asyncEvents.push(event);
@@ -733,6 +763,10 @@ void RPIServiceImpl::executeOnMainThread(std::function<void()> const& f, ServerC
       condVar.notify_one();
       R_interrupts_pending = 0;
     }};
+    // Note: non-immediate tasks may run arbitrary R code, so cached values can become stale.
+    // Immediate tasks may interrupt a running command which keeps changing the values between them,
+    // while at a prompt nothing changes them until the next non-immediate task or the next prompt
+    if (!immediate || replState == REPL_BUSY) invalidateDereferenceCache();
     try {
       f();
     } catch (RUnwindException const&) {
@@ -21,6 +21,7 @@
 #include "protos/service.grpc.pb.h"
 #include <string>
 #include <functional>
+#include <unordered_map>
 #include "util/BlockingQueue.h"
 #include "util/IndexedStorage.h"
 #include "IO.h"
@@ -170,6 +171,7 @@ public:
 
   void setValueImpl(RRef const& ref, SEXP value);
   SEXP dereference(RRef const& ref);
+  void invalidateDereferenceCache();
 
   OutputHandler replOutputHandler;
   void writeToReplOutputHandler(std::string const& s, OutputType type);
@@ -193,6 +195,14 @@ private:
 
   std::vector<RDebuggerStackFrame> lastErrorStack;
 
+  // Results of dereference() keyed by serialized RRef, valid until the R state may have changed.
+  // Note: it's invalidated on prompts, on tasks which may run arbitrary code and on assignments.
+  // Immediate tasks running while R is busy see it only within a single task
+  std::unordered_map<std::string, PrSEXP> dereferenceCache;
+  std::unordered_map<std::string, PrSEXP> parsedExpressionCache;
+  SEXP dereferenceImpl(RRef const& ref);
+  SEXP parseExpressionRef(std::string const& code);
+
   Status executeCommand(ServerContext* context, const std::string& command, ServerWriter<CommandOutput>* writer);
 
   Status replExecuteCommand(ServerContext* context, const std::string& command);
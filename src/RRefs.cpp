@@ -22,10 +22,49 @@
 #include "EventLoop.h"
 #include "RStuff/RObjects.h"
 #include "RLoader.h"
+#include "RStuff/Fingerprint.h"
+#include <cmath>
 
 const int EVALUATE_AS_TEXT_MAX_LENGTH = 500000;
+const int PARSED_EXPRESSION_CACHE_MAX_SIZE = 256;
+const int DEREFERENCE_CACHE_MAX_SIZE = 1024;
 
 SEXP RPIServiceImpl::dereference(RRef const& ref) {
+  switch (ref.ref_case()) {
+    case RRef::kMember:
+    case RRef::kParentEnv:
+    case RRef::kListElement:
+    case RRef::kAttributes:
+      break;
+    default:
+      // Note: expressions may have side effects, so they are evaluated every time
+      return dereferenceImpl(ref);
+  }
+  std::string key = ref.SerializeAsString();
+  auto it = dereferenceCache.find(key);
+  if (it != dereferenceCache.end()) return it->second;
+  if (dereferenceCache.size() >= DEREFERENCE_CACHE_MAX_SIZE) {
+    dereferenceCache.clear();
+  }
+  PrSEXP value = dereferenceImpl(ref);
+  return dereferenceCache.emplace(std::move(key), value).first->second;
+}
+
+void RPIServiceImpl::invalidateDereferenceCache() {
+  dereferenceCache.clear();
+}
+
+SEXP RPIServiceImpl::parseExpressionRef(std::string const& code) {
+  auto it = parsedExpressionCache.find(code);
+  if (it != parsedExpressionCache.end()) return it->second;
+  if (parsedExpressionCache.size() >= PARSED_EXPRESSION_CACHE_MAX_SIZE) {
+    parsedExpressionCache.clear();
+  }
+  PrSEXP parsed = parseCode(code);
+  return parsedExpressionCache.emplace(code, parsed).first->second;
+}
+
+SEXP RPIServiceImpl::dereferenceImpl(RRef const& ref) {
   switch (ref.ref_case()) {
     case RRef::kPersistentIndex: {
       int i = ref.persistentindex();
@@ -63,8 +102,11 @@ SEXP RPIServiceImpl::dereference(RRef const& ref) {
     }
     case RRef::kExpression: {
       ShieldSEXP env = dereference(ref.expression().env());
-      std::string code = ref.expression().code();
-      return RI->eval(parseCode(code), named("envir", env));
+      ShieldSEXP expressions = parseExpressionRef(ref.expression().code());
+      ShieldSEXP result = RI->eval(expressions, named("envir", env));
+      // Note: the expression might have assigned something
+      invalidateDereferenceCache();
+      return result;
     }
     case RRef::kListElement: {
       ShieldSEXP list = dereference(ref.listelement().list());
@@ -95,6 +137,7 @@ Status RPIServiceImpl::copyToPersistentRef(ServerContext* context, const RRef* r
 Status RPIServiceImpl::disposePersistentRefs(ServerContext*, const PersistentRefList* request, Empty*) {
   std::vector<int> refs(request->indices().begin(), request->indices().end());
   eventLoopExecute([=] {
+    invalidateDereferenceCache();
     for (int ref : refs) {
       if (persistentRefStorage.has(ref)) {
         persistentRefStorage.remove(ref);
@@ -108,10 +151,23 @@ Status RPIServiceImpl::evaluateAsText(ServerContext* context, const RRef* reques
   executeOnMainThread([&] {
     try {
       PrSEXP value = dereference(*request);
+      R_xlen_t length = Rf_xlength(value);
+      // Note: the prefix doesn't exceed the user's "max.print", so R prints all of it without a note
+      // of its own (which would count omitted entries of the prefix only)
+      double maxPrint = asDouble(RI->getOption("max.print"));
+      R_xlen_t maxCount = std::isfinite(maxPrint) && maxPrint >= 1 && maxPrint < (double)R_XLEN_T_MAX
+          ? (R_xlen_t)maxPrint : R_XLEN_T_MAX;
+      bool truncated;
+      value = getPrintablePrefix(value, EVALUATE_AS_TEXT_MAX_LENGTH, maxCount, truncated);
       if (value.type() == STRSXP) {
         value = RI->substring(value, 1, EVALUATE_AS_TEXT_MAX_LENGTH);
       }
-      response->set_value(getPrintedValueWithLimit(value, EVALUATE_AS_TEXT_MAX_LENGTH));
+      bool trimmed;
+      std::string text = getPrintedValueWithLimit(value, EVALUATE_AS_TEXT_MAX_LENGTH, trimmed);
+      if (truncated && !trimmed) {
+        text += " [ omitted " + std::to_string((long long)(length - Rf_xlength(value))) + " entries ]\n";
+      }
+      response->set_value(text);
     } catch (RExceptionBase const& e) {
       response->set_error(e.what());
     } catch (...) {
@@ -156,7 +212,14 @@ Status RPIServiceImpl::getDistinctStrings(ServerContext* context, const RRef* re
 
 Status RPIServiceImpl::loadObjectNames(ServerContext* context, const RRef* request, StringList* response) {
   executeOnMainThread([&] {
-    ShieldSEXP names = RI->ls(dereference(*request), named("all.names", true));
+    ShieldSEXP env = dereference(*request);
+    if (env.type() == ENVSXP) {
+      for (SEXP symbol : getBindingSymbols(env, true)) {
+        response->add_list(Rf_translateCharUTF8(PRINTNAME(symbol)));
+      }
+      return;
+    }
+    ShieldSEXP names = RI->ls(env, named("all.names", true));
     if (names.type() != STRSXP) return;
     for (int i = 0; i < names.length(); ++i) {
       response->add_list(stringEltUTF8(names, i));
@@ -245,7 +308,7 @@ Status RPIServiceImpl::getRMarkdownChunkOptions(ServerContext* context, const Em
 Status RPIServiceImpl::getEqualityObject(ServerContext* context, const RRef* request, Int64Value* response) {
   executeOnMainThread([&] {
     try {
-      response->set_value((long long)(SEXP)dereference(*request));
+      response->set_value((long long)getFingerprint(dereference(*request)));
     } catch (RExceptionBase const&) {
       response->set_value(0);
     }
@@ -283,6 +346,7 @@ Status RPIServiceImpl::setValue(ServerContext* context, const SetValueRequest* r
   executeOnMainThread([&] {
     try {
       ShieldSEXP value = dereference(request->value());
+      auto finally = Finally{[&] { invalidateDereferenceCache(); }};
       setValueImpl(request->ref(), value);
       getValueInfo(value, response);
     } catch (RExceptionBase const& e) {
@@ -0,0 +1,101 @@
+//  Rkernel is an execution kernel for R interpreter
+//  Copyright (C) 2019 JetBrains s.r.o.
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#include "Fingerprint.h"
+#include <algorithm>
+#include <cstring>
+
+static const R_xlen_t CONTENT_SAMPLE_COUNT = 64;
+
+static uint64_t mix(uint64_t h, uint64_t v) {
+  // splitmix64 finalizer over the combined value
+  uint64_t z = h ^ (v + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2));
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
+
+template <typename T>
+static uint64_t toBits(T const& value) {
+  uint64_t bits = 0;
+  memcpy(&bits, &value, std::min(sizeof(T), sizeof(bits)));
+  return bits;
+}
+
+template <typename T, typename Get>
+static uint64_t sampleContent(uint64_t h, R_xlen_t length, Get const& get) {
+  if (length <= CONTENT_SAMPLE_COUNT) {
+    for (R_xlen_t i = 0; i < length; ++i) h = mix(h, toBits<T>(get(i)));
+    return h;
+  }
+  R_xlen_t step = length / CONTENT_SAMPLE_COUNT;
+  for (R_xlen_t i = 0; i < length; i += step) h = mix(h, toBits<T>(get(i)));
+  return mix(h, toBits<T>(get(length - 1)));
+}
+
+static uint64_t fingerprintImpl(SEXP x, int& budget) {
+  uint64_t h = mix(0, (uint64_t)(uintptr_t)x);
+  if (x == R_NilValue || budget <= 0) return h;
+  --budget;
+  h = mix(h, (uint64_t)TYPEOF(x));
+  if (ATTRIB(x) != R_NilValue) {
+    h = mix(h, fingerprintImpl(ATTRIB(x), budget));
+  }
+  switch (TYPEOF(x)) {
+    case LGLSXP: case INTSXP: case REALSXP: case CPLXSXP: case RAWSXP: case STRSXP: {
+      R_xlen_t length = Rf_xlength(x);
+      h = mix(h, (uint64_t)length);
+#if R_VERSION >= R_Version(3, 5, 0)
+      // Note: accessing the data pointer of ALTREP objects could materialize them
+      if (ALTREP(x)) return h;
+#endif
+      switch (TYPEOF(x)) {
+        case LGLSXP: return sampleContent<int>(h, length, [&](R_xlen_t i) { return LOGICAL(x)[i]; });
+        case INTSXP: return sampleContent<int>(h, length, [&](R_xlen_t i) { return INTEGER(x)[i]; });
+        case REALSXP: return sampleContent<double>(h, length, [&](R_xlen_t i) { return REAL(x)[i]; });
+        case CPLXSXP: return sampleContent<double>(h, length, [&](R_xlen_t i) { return COMPLEX(x)[i].r + COMPLEX(x)[i].i; });
+        case RAWSXP: return sampleContent<Rbyte>(h, length, [&](R_xlen_t i) { return RAW(x)[i]; });
+        // Note: CHARSXPs are cached, so equal addresses mean equal strings
+        default: return sampleContent<SEXP>(h, length, [&](R_xlen_t i) { return STRING_ELT(x, i); });
+      }
+    }
+    case VECSXP:
+    case EXPRSXP: {
+      R_xlen_t length = Rf_xlength(x);
+      h = mix(h, (uint64_t)length);
+      for (R_xlen_t i = 0; i < length; ++i) {
+        SEXP element = VECTOR_ELT(x, i);
+        h = mix(h, budget > 0 ? fingerprintImpl(element, budget) : (uint64_t)(uintptr_t)element);
+      }
+      return h;
+    }
+    case LISTSXP:
+    case LANGSXP: {
+      for (SEXP cur = x; cur != R_NilValue && budget > 0; cur = CDR(cur)) {
+        h = mix(h, (uint64_t)(uintptr_t)TAG(cur));
+        h = mix(h, fingerprintImpl(CAR(cur), budget));
+      }
+      return h;
+    }
+    default:
+      return h;
+  }
+}
+
+uint64_t getFingerprint(SEXP x, int budget) {
+  return fingerprintImpl(x, budget);
+}
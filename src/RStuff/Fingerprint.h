@@ -0,0 +1,31 @@
+//  Rkernel is an execution kernel for R interpreter
+//  Copyright (C) 2019 JetBrains s.r.o.
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#ifndef RWRAPPER_R_STUFF_FINGERPRINT_H
+#define RWRAPPER_R_STUFF_FINGERPRINT_H
+
+#include "RInclude.h"
+#include <cstdint>
+
+const int DEFAULT_FINGERPRINT_BUDGET = 1000;
+
+// 64-bit fingerprint of a value which changes whenever the value is (very likely) changed.
+// Combines the address, type, length and attributes with a sampled content hash,
+// lists are traversed until the budget of visited nodes is exhausted. No R code is evaluated.
+uint64_t getFingerprint(SEXP x, int budget = DEFAULT_FINGERPRINT_BUDGET);
+
+#endif //RWRAPPER_R_STUFF_FINGERPRINT_H
@@ -19,6 +19,8 @@
 #include "Exceptions.h"
 #include "RObjects.h"
 #include <cstring>
+#include <iostream>
+#include <vector>
 #include "RUtil.h"
 
 #ifdef RWRAPPER_DEBUG
@@ -26,6 +28,88 @@ int unprotectCheckDisabled = 0;
 #endif
 std::unique_ptr<RObjects2> RI;
 
+namespace protectionTable {
+namespace {
+const int INITIAL_CAPACITY = 1024;
+
+struct Table {
+  SEXP slots = R_NilValue;
+  std::vector<int> refCounts;
+  std::vector<int> freeSlots;
+  int live = 0;
+
+  void grow() {
+    int oldCapacity = (int)refCounts.size();
+    int newCapacity = oldCapacity == 0 ? INITIAL_CAPACITY : oldCapacity * 2;
+    SEXP newSlots = Rf_allocVector(VECSXP, newCapacity);
+    R_PreserveObject(newSlots);
+    for (int i = 0; i < oldCapacity; ++i) {
+      SET_VECTOR_ELT(newSlots, i, VECTOR_ELT(slots, i));
+    }
+    if (slots != R_NilValue) R_ReleaseObject(slots);
+    slots = newSlots;
+    refCounts.resize(newCapacity, 0);
+    freeSlots.reserve(newCapacity);
+    for (int i = newCapacity - 1; i >= oldCapacity; --i) {
+      freeSlots.push_back(i);
+    }
+  }
+};
+
+// Note: intentionally never destroyed since static PrSEXPs may be released after static destructors run
+Table& table() {
+  static auto instance = new Table();
+  return *instance;
+}
+} // anonymous
+
+int protect(SEXP x) {
+  auto& t = table();
+  if (t.freeSlots.empty()) {
+    PROTECT(x);
+    t.grow();
+    UNPROTECT(1);
+  }
+  int slot = t.freeSlots.back();
+  t.freeSlots.pop_back();
+  SET_VECTOR_ELT(t.slots, slot, x);
+  t.refCounts[slot] = 1;
+  ++t.live;
+  return slot;
+}
+
+void retain(int slot) {
+  ++table().refCounts[slot];
+}
+
+void release(int slot) {
+  auto& t = table();
+  assert(t.refCounts[slot] > 0);
+  if (--t.refCounts[slot] == 0) {
+    SET_VECTOR_ELT(t.slots, slot, R_NilValue);
+    t.freeSlots.push_back(slot);
+    --t.live;
+  }
+}
+
+int liveCount() {
+  return table().live;
+}
+
+void reportLeaks() {
+#ifdef RWRAPPER_DEBUG
+  auto& t = table();
+  if (t.live == 0) return;
+  std::cerr << "PrSEXP protection table: " << t.live << " protection(s) still alive at shutdown\n";
+  for (int i = 0; i < (int)t.refCounts.size(); ++i) {
+    if (t.refCounts[i] == 0) continue;
+    std::cerr << "  slot " << i << ": " << Rf_type2char(TYPEOF(VECTOR_ELT(t.slots, i)))
+              << ", refcount " << t.refCounts[i] << "\n";
+  }
+#endif
+}
+} // protectionTable
+
 static SEXP createErrorHandler() {
   ShieldSEXP text = toSEXP(""
       "function(e) {\n"
@@ -178,33 +178,53 @@ private:
   }
 };
 
+// Kernel-owned protection table for PrSEXP.
+// All protected objects live in slots of a single VECSXP which is preserved once,
+// so protecting and releasing is O(1) instead of a linear scan of R's precious list.
+// Each slot is reference-counted, copies of PrSEXP share the slot.
+namespace protectionTable {
+  int protect(SEXP x);
+  void retain(int slot);
+  void release(int slot);
+  int liveCount();
+  void reportLeaks();
+}
+
 class PrSEXP : public BaseSEXP {
 public:
   PrSEXP() : BaseSEXP(R_NilValue) {}
 
   PrSEXP(SEXP sexp) : BaseSEXP(sexp) {
-    if (sexp != R_NilValue) R_PreserveObject(sexp);
+    if (sexp != R_NilValue) slot = protectionTable::protect(sexp);
+  }
+
+  PrSEXP(PrSEXP const& b) : BaseSEXP(b.x), slot(b.slot) {
+    if (slot != -1) protectionTable::retain(slot);
   }
 
-  PrSEXP(PrSEXP const& b) : PrSEXP((SEXP)b) {}
   PrSEXP(BaseSEXP const& b) : PrSEXP((SEXP)b) {}
 
-  PrSEXP(PrSEXP&& b) noexcept : BaseSEXP(b.x) {
+  PrSEXP(PrSEXP&& b) noexcept : BaseSEXP(b.x), slot(b.slot) {
     b.x = R_NilValue;
+    b.slot = -1;
   }
 
   ~PrSEXP() {
-    if (x != R_NilValue) R_ReleaseObject(x);
+    if (slot != -1) protectionTable::release(slot);
   }
 
   void swap(PrSEXP &rhs) {
     std::swap(x, rhs.x);
+    std::swap(slot, rhs.slot);
   }
 
   PrSEXP& operator = (PrSEXP rhs) {
     swap(rhs);
     return *this;
   }
+
+private:
+  int slot = -1;
 };
 
 #ifdef RWRAPPER_DEBUG
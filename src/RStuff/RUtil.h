@@ -18,6 +18,8 @@
 #ifndef RWRAPPER_R_UTIL_H
 #define RWRAPPER_R_UTIL_H
 
+#include <algorithm>
+#include <cstring>
 #include <vector>
 #include <string>
 #include "../debugger/RDebugger.h"
@@ -125,6 +127,50 @@ inline std::string getPrintedValueWithLimit(SEXP a, int maxLength) {
   return getPrintedValueWithLimit(a, maxLength, trimmed);
 }
 
+// For long atomic vectors returns a prefix which is enough to print maxLength characters
+// (every printed element takes at least two characters), so that formatting is O(maxLength).
+// The prefix is never longer than maxCount elements (say, getOption("max.print")).
+inline SEXP getPrintablePrefix(SEXP x, int maxLength, R_xlen_t maxCount, bool &truncated) {
+  truncated = false;
+  switch (TYPEOF(x)) {
+    case LGLSXP: case INTSXP: case REALSXP: case CPLXSXP: case STRSXP: case RAWSXP:
+      break;
+    default:
+      return x;
+  }
+  R_xlen_t length = Rf_xlength(x);
+  R_xlen_t prefixLength = std::max((R_xlen_t)1, std::min((R_xlen_t)(maxLength / 2 + 1), maxCount));
+  if (length <= prefixLength || Rf_getAttrib(x, R_DimSymbol) != R_NilValue) return x;
+  truncated = true;
+  if (OBJECT(x)) {
+    return RI->subscript(x, RI->colon(1, (double)prefixLength));
+  }
+  ShieldSEXP prefix = Rf_allocVector(TYPEOF(x), prefixLength);
+  switch (TYPEOF(x)) {
+    case LGLSXP: std::copy(LOGICAL(x), LOGICAL(x) + prefixLength, LOGICAL(prefix)); break;
+    case INTSXP: std::copy(INTEGER(x), INTEGER(x) + prefixLength, INTEGER(prefix)); break;
+    case REALSXP: std::copy(REAL(x), REAL(x) + prefixLength, REAL(prefix)); break;
+    case CPLXSXP: std::copy(COMPLEX(x), COMPLEX(x) + prefixLength, COMPLEX(prefix)); break;
+    case RAWSXP: std::copy(RAW(x), RAW(x) + prefixLength, RAW(prefix)); break;
+    case STRSXP: {
+      for (R_xlen_t i = 0; i < prefixLength; ++i) SET_STRING_ELT(prefix, i, STRING_ELT(x, i));
+      break;
+    }
+  }
+  ShieldSEXP names = Rf_getAttrib(x, R_NamesSymbol);
+  if (names.type() == STRSXP) {
+    ShieldSEXP prefixNames = Rf_allocVector(STRSXP, prefixLength);
+    for (R_xlen_t i = 0; i < prefixLength; ++i) SET_STRING_ELT(prefixNames, i, STRING_ELT(names, i));
+    Rf_setAttrib(prefix, R_NamesSymbol, prefixNames);
+  }
+  return prefix;
+}
+
+inline SEXP getPrintablePrefix(SEXP x, int maxLength) {
+  bool truncated;
+  return getPrintablePrefix(x, maxLength, R_XLEN_T_MAX, truncated);
+}
+
 inline const char* translateToNative(const char* s) {
   return Rf_translateChar(mkCharUTF8(s));
 }
@@ -309,6 +355,85 @@ inline SEXP createFinalizer(Func fin) {
   return e;
 }
 
+enum class BindingKind {
+  VALUE, PROMISE, ACTIVE
+};
+
+struct EnvBinding {
+  SEXP symbol;
+  SEXP value; // R_NilValue for active bindings, promises are not forced
+  BindingKind kind;
+  bool locked;
+};
+
+inline bool isBindingNameAccepted(SEXP symbol, bool allNames, std::string const& prefix) {
+  if (symbol == R_NilValue) return false;
+  const char* name = CHAR(PRINTNAME(symbol));
+  if (!allNames && name[0] == '.') return false;
+  return prefix.empty() || !strncmp(Rf_translateCharUTF8(PRINTNAME(symbol)), prefix.c_str(), prefix.size());
+}
+
+// Lists symbols bound in the frame of env by walking the frame or the hash table directly.
+// Unlike ls(), the result is in internal order unless sorted is requested, no STRSXP is allocated.
+inline std::vector<SEXP> getBindingSymbols(SEXP env, bool allNames, std::string const& prefix = "", bool sorted = false) {
+  std::vector<SEXP> result;
+  if (TYPEOF(env) != ENVSXP || env == R_EmptyEnv) return result;
+  auto addFrame = [&](SEXP frame) {
+    for (; frame != R_NilValue; frame = CDR(frame)) {
+      if (isBindingNameAccepted(TAG(frame), allNames, prefix)) result.push_back(TAG(frame));
+    }
+  };
+  if (env == R_BaseEnv || env == R_BaseNamespace || (OBJECT(env) && Rf_inherits(env, "UserDefinedDatabase"))) {
+    // Note: base bindings live in the global symbol table
+    ShieldSEXP names = R_lsInternal3(env, (Rboolean)allNames, FALSE);
+    for (R_xlen_t i = 0; i < Rf_xlength(names); ++i) {
+      SEXP symbol = Rf_installChar(STRING_ELT(names, i));
+      if (isBindingNameAccepted(symbol, allNames, prefix)) result.push_back(symbol);
+    }
+  } else if (HASHTAB(env) != R_NilValue) {
+    SEXP table = HASHTAB(env);
+    R_xlen_t size = Rf_xlength(table);
+    for (R_xlen_t i = 0; i < size; ++i) {
+      addFrame(VECTOR_ELT(table, i));
+    }
+  } else {
+    addFrame(FRAME(env));
+  }
+  if (sorted) {
+    // Note: collate native strings as `sort(ls())` does, translation is done once per name
+    const void* vmax = vmaxget();
+    std::vector<std::pair<const char*, SEXP>> names;
+    names.reserve(result.size());
+    for (SEXP symbol : result) {
+      names.emplace_back(Rf_translateChar(PRINTNAME(symbol)), symbol);
+    }
+    std::sort(names.begin(), names.end(), [](std::pair<const char*, SEXP> const& a, std::pair<const char*, SEXP> const& b) {
+      return strcoll(a.first, b.first) < 0;
+    });
+    for (size_t i = 0; i < names.size(); ++i) {
+      result[i] = names[i].second;
+    }
+    vmaxset(vmax);
+  }
+  return result;
+}
+
+// Classifies a binding without forcing promises or calling active binding functions
+inline EnvBinding getBinding(SEXP env, SEXP symbol) {
+  EnvBinding binding = {symbol, R_NilValue, BindingKind::VALUE, (bool)R_BindingIsLocked(symbol, env)};
+  if (R_BindingIsActive(symbol, env)) {
+    binding.kind = BindingKind::ACTIVE;
+    return binding;
+  }
+  binding.value = Rf_findVarInFrame3(env, symbol, TRUE);
+  if (binding.value == R_UnboundValue) {
+    binding.value = R_NilValue;
+  } else if (TYPEOF(binding.value) == PROMSXP) {
+    binding.kind = BindingKind::PROMISE;
+  }
+  return binding;
+}
+
 template<class Func>
 inline void walkObjectsImpl(Func const& f, std::unordered_set<SEXP> &visited, SEXP x) {
   if (x == R_NilValue || x == R_UnboundValue || TYPEOF(x) == CHARSXP || visited.count(x)) return;
@@ -337,12 +462,8 @@ inline void walkObjectsImpl(Func const& f, std::unordered_set<SEXP> &visited, SE
     }
     case ENVSXP: {
       if (x == R_BaseEnv || x == R_BaseNamespace) {
-        ShieldSEXP names = RI->ls(R_BaseEnv, named("all.names", true));
-        if (names.type() == STRSXP) {
-          int length = names.length();
-          for (int i = 0; i < length; ++i) {
-            walkObjectsImpl(f, visited, RI->baseEnv.getVar(stringEltNative(names, i), false));
-          }
+        for (SEXP symbol : getBindingSymbols(R_BaseEnv, true)) {
+          walkObjectsImpl(f, visited, getBinding(R_BaseEnv, symbol).value);
         }
       } else if (x != R_EmptyEnv) {
         walkObjectsImpl(f, visited, ENCLOS(x));
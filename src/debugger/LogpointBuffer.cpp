@@ -0,0 +1,108 @@
+//  Rkernel is an execution kernel for R interpreter
+//  Copyright (C) 2019 JetBrains s.r.o.
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "LogpointBuffer.h"
+#include "../RPIServiceImpl.h"
+#include <cstdio>
+#include <ctime>
+
+static const size_t MAX_BUFFERED_HITS = 1000;
+static const size_t MAX_STACK_TEXTS = 1000;
+static const auto MAX_HIT_AGE = std::chrono::milliseconds(100);
+
+static std::string formatTime(std::chrono::system_clock::time_point time) {
+  auto seconds = std::chrono::system_clock::to_time_t(time);
+  auto milliseconds = std::chrono::duration_cast<std::chrono::milliseconds>(time.time_since_epoch()).count() % 1000;
+  char buffer[32];
+  std::tm local = *std::localtime(&seconds);
+  size_t length = std::strftime(buffer, sizeof(buffer), "%H:%M:%S", &local);
+  snprintf(buffer + length, sizeof(buffer) - length, ".%03d", (int)milliseconds);
+  return buffer;
+}
+
+void LogpointBuffer::add(LogpointHit hit) {
+  hits.push_back(std::move(hit));
+  if (hits.size() >= MAX_BUFFERED_HITS || hits.back().time - hits.front().time >= MAX_HIT_AGE) {
+    flush();
+  }
+}
+
+void LogpointBuffer::flushIfStale() {
+  if (!hits.empty() && std::chrono::system_clock::now() - hits.front().time >= MAX_HIT_AGE) {
+    flush();
+  }
+}
+
+static size_t getKeyHash(std::vector<PrSEXP> const& key) {
+  std::hash<SEXP> hashSexp;
+  size_t hash = key.size();
+  for (auto const& x : key) {
+    hash ^= hashSexp(x) + 0x9e3779b97f4a7c15ULL + (hash << 6U) + (hash >> 2U);
+  }
+  return hash;
+}
+
+static bool isSameKey(std::vector<PrSEXP> const& a, std::vector<PrSEXP> const& b) {
+  if (a.size() != b.size()) return false;
+  for (size_t i = 0; i < a.size(); ++i) {
+    if ((SEXP)a[i] != (SEXP)b[i]) return false;
+  }
+  return true;
+}
+
+int LogpointBuffer::findStack(std::vector<PrSEXP> const& key) const {
+  auto range = hash2StackIds.equal_range(getKeyHash(key));
+  for (auto it = range.first; it != range.second; ++it) {
+    if (isSameKey(stackTexts[it->second].key, key)) {
+      return it->second;
+    }
+  }
+  return -1;
+}
+
+int LogpointBuffer::putStack(std::vector<PrSEXP> key, std::string text) {
+  if (stackTexts.size() >= MAX_STACK_TEXTS) {
+    flush();
+    stackTexts.clear();
+    hash2StackIds.clear();
+  }
+  int id = stackTexts.size();
+  hash2StackIds.emplace(getKeyHash(key), id);
+  stackTexts.push_back({std::move(key), std::move(text)});
+  return id;
+}
+
+void LogpointBuffer::flush() {
+  if (hits.empty()) return;
+  std::string text;
+  for (auto const& hit : hits) {
+    if (hit.suppressedCount > 0) {
+      text += "\n[" + std::to_string(hit.suppressedCount) + " breakpoint hits were not logged]";
+    }
+    text += "\n[" + formatTime(hit.time) + "] ";
+    if (!hit.position.empty() || hit.stackId != -1) {
+      text += "Breakpoint hit";
+      if (!hit.position.empty()) text += " (" + hit.position + ")";
+      text += hit.stackId != -1 ? ":\n" : "\n";
+    }
+    if (hit.stackId != -1) {
+      text += stackTexts[hit.stackId].text;
+    }
+    text += hit.value;
+  }
+  hits.clear();
+  rpiService->writeToReplOutputHandler(text, STDERR);
+}
@@ -0,0 +1,64 @@
+//  Rkernel is an execution kernel for R interpreter
+//  Copyright (C) 2019 JetBrains s.r.o.
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#ifndef RWRAPPER_LOGPOINT_BUFFER_H
+#define RWRAPPER_LOGPOINT_BUFFER_H
+
+#include <chrono>
+#include <cstddef>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "../RStuff/MySEXP.h"
+
+struct LogpointHit {
+  std::chrono::system_clock::time_point time;
+  std::string position;  // Empty if the hit message is not requested
+  std::string value;  // Printed value of the log expression
+  int stackId = -1;  // -1 if the stack is not requested
+  int suppressedCount = 0;  // Hits of the breakpoint which were not logged before this one due to the rate limit
+};
+
+/*
+ * Bounded buffer of hits of non-suspending breakpoints.
+ * Hits are written to the console as a single chunk of text when the buffer is full,
+ * when its oldest hit is stale (checked on new hits and from R's event processing, see `flushIfStale()`)
+ * or when the output is requested explicitly (e.g. before the debug prompt or any synchronous breakpoint output).
+ * Stacks are rendered once per distinct key. A key consists of the calls, functions and srcrefs of the contexts:
+ * they determine the printed stack and are protected while their text is stored, so their addresses
+ * can't be reused by the GC for different objects.
+ */
+class LogpointBuffer {
+public:
+  void add(LogpointHit hit);
+  int findStack(std::vector<PrSEXP> const& key) const;  // Returns -1 if there is no text for the key
+  int putStack(std::vector<PrSEXP> key, std::string text);
+  void flush();
+  void flushIfStale();
+
+private:
+  struct StackText {
+    std::vector<PrSEXP> key;
+    std::string text;
+  };
+
+  std::vector<LogpointHit> hits;
+  std::vector<StackText> stackTexts;
+  std::unordered_multimap<size_t, int> hash2StackIds;
+};
+
+#endif //RWRAPPER_LOGPOINT_BUFFER_H
@@ -38,6 +38,16 @@ void RDebugger::init() {
                RI->doNotStopFlag, toSEXP(true));
 
   overrideDebuggerPrimitives();
+
+#ifndef Win32
+  // Note: R processes events periodically during long computations, so buffered logpoint hits
+  // don't get stuck when no more breakpoints are hit
+  static void (*oldPolledEvents)() = R_PolledEvents;
+  R_PolledEvents = [] {
+    if (oldPolledEvents != nullptr) oldPolledEvents();
+    rDebugger.flushStaleLogpoints();
+  };
+#endif
 }
 
 static void overrideDoEval(bool enabled);
@@ -68,6 +78,23 @@ void RDebugger::clearSavedStack() {
 
 void RDebugger::muteBreakpoints(bool mute) {
   breakpointsMuted = mute;
+  breakpointsVersion++;
+  updateBytecode();
+}
+
+static SEXP parseBreakpointCode(std::string const& code, std::string& error) {
+  error.clear();
+  if (code.empty()) return R_NilValue;
+  try {
+    WithDebuggerEnabled with(false);
+    ShieldSEXP exprs = parseCode(code);
+    if (exprs.length() == 1) return exprs[0];
+    ShieldSEXP args = Rf_VectorToPairList(exprs);
+    return Rf_lcons(RI->beginSymbol, args);
+  } catch (RError const& e) {
+    error = e.what();
+    return R_NilValue;
+  }
 }
 
 void RDebugger::addOrModifyBreakpoint(DebugAddOrModifyBreakpointRequest const& request) {
@@ -83,25 +110,43 @@ void RDebugger::addOrModifyBreakpoint(DebugAddOrModifyBreakpointRequest const& r
 
   breakpoint->enabled = request.enabled();
   breakpoint->suspend = request.suspend();
-  breakpoint->condition = request.condition();
-  breakpoint->evaluateAndLog = request.evaluateandlog();
+  if (breakpoint->condition != request.condition()) {
+    breakpoint->condition = request.condition();
+    breakpoint->conditionExpr = parseBreakpointCode(breakpoint->condition, breakpoint->conditionError);
+    if (!breakpoint->conditionError.empty()) {
+      rpiService->writeToReplOutputHandler("\nCannot parse breakpoint condition: " + breakpoint->conditionError + "\n", STDERR);
+    }
+  }
+  if (breakpoint->evaluateAndLog != request.evaluateandlog()) {
+    breakpoint->evaluateAndLog = request.evaluateandlog();
+    breakpoint->evaluateAndLogExpr = parseBreakpointCode(breakpoint->evaluateAndLog, breakpoint->evaluateAndLogError);
+    if (!breakpoint->evaluateAndLogError.empty()) {
+      rpiService->writeToReplOutputHandler("\nCannot parse breakpoint log expression: " + breakpoint->evaluateAndLogError + "\n", STDERR);
+    }
+  }
   breakpoint->hitMessage = request.hitmessage();
   breakpoint->printStack = request.printstack();
   breakpoint->removeAfterHit = request.removeafterhit();
+  // Note: passes are counted from the last modification, the same way as for `setBreakpointHitPolicy()`
+  breakpoint->passCount = 0;
 
   VirtualFileInfoPtr oldFile = breakpoint->virtualFile;
   int oldLine = breakpoint->line;
   if (oldFile != newFile || oldLine != newLine) {
     if (!oldFile.isNull()) {
       removeFromVector(oldFile->breakpointsByLine[oldLine], breakpoint.get());
+      oldFile->breakpointCount--;
     }
     if (newFile->breakpointsByLine.size() <= newLine) {
       newFile->breakpointsByLine.resize(newLine + 1);
     }
     newFile->breakpointsByLine[newLine].push_back(breakpoint.get());
+    newFile->breakpointCount++;
     breakpoint->virtualFile = newFile.getExtPtr();
     breakpoint->line = newLine;
   }
+  breakpointsVersion++;
+  updateBytecode();
 }
 
 void RDebugger::removeBreakpointById(int id) {
@@ -114,7 +159,10 @@ void RDebugger::removeBreakpointById(int id) {
   }
   VirtualFileInfoPtr file = breakpoint->virtualFile;
   removeFromVector(file->breakpointsByLine[breakpoint->line], breakpoint);
+  file->breakpointCount--;
   breakpoints.erase(it);
+  breakpointsVersion++;
+  updateBytecode();
 }
 
 Breakpoint* RDebugger::getBreakpointById(int id) {
@@ -136,6 +184,18 @@ void RDebugger::setMasterBreakpoint(Breakpoint* breakpoint, Breakpoint* newMaste
   }
 }
 
+void RDebugger::setBreakpointHitPolicy(int id, int hitNumber, int hitModulo, int firstHits, int maxLogsPerSecond) {
+  Breakpoint* breakpoint = getBreakpointById(id);
+  if (breakpoint == nullptr) return;
+  breakpoint->hitNumber = std::max(hitNumber, 0);
+  breakpoint->hitModulo = std::max(hitModulo, 0);
+  breakpoint->firstHits = std::max(firstHits, 0);
+  breakpoint->maxLogsPerSecond = std::max(maxLogsPerSecond, 0);
+  breakpoint->passCount = 0;
+  breakpoint->logWindowCount = 0;
+  breakpoint->suppressedLogCount = 0;
+}
+
 void RDebugger::setCommand(DebuggerCommand c) {
   currentCommand = c;
   if (c == CONTINUE || c == STEP_INTO || c == STEP_INTO_MY_CODE || c == ABORT || c == PAUSE) return;
@@ -160,32 +220,78 @@ void RDebugger::setRunToPositionCommand(std::string const& fileId, int line) {
   runToPositionTarget = {sourceFileManager.getVirtualFileById(fileId), line};
 }
 
-static bool checkCondition(std::string const& condition, SEXP env) {
-  SHIELD(env);
-  if (condition.empty()) {
+static bool checkHitPolicy(Breakpoint* breakpoint) {
+  // Note: passes are not counted at all without a policy, otherwise the counter would overflow in long loops
+  if (breakpoint->hitNumber <= 0 && breakpoint->hitModulo <= 0 && breakpoint->firstHits <= 0) return true;
+  int pass = ++breakpoint->passCount;
+  if (breakpoint->hitNumber > 0 && pass != breakpoint->hitNumber) {
+    if (pass > breakpoint->hitNumber) breakpoint->passCount = breakpoint->hitNumber;  // Note: prevent overflow in long loops
+    return false;
+  }
+  if (breakpoint->firstHits > 0 && pass > breakpoint->firstHits) {
+    breakpoint->passCount = breakpoint->firstHits;  // Note: prevent overflow in long loops
+    return false;
+  }
+  if (breakpoint->hitModulo > 0) {
+    if (pass % breakpoint->hitModulo != 0) return false;
+    // Note: the other policies bound the counter themselves, otherwise it only matters modulo `hitModulo`
+    if (breakpoint->hitNumber <= 0 && breakpoint->firstHits <= 0) breakpoint->passCount = 0;
+  }
+  return true;
+}
+
+static bool checkLogRate(Breakpoint* breakpoint) {
+  if (breakpoint->maxLogsPerSecond <= 0) return true;
+  auto now = std::chrono::steady_clock::now();
+  if (now - breakpoint->logWindowStart >= std::chrono::seconds(1)) {
+    breakpoint->logWindowStart = now;
+    breakpoint->logWindowCount = 0;
+  }
+  if (breakpoint->logWindowCount >= breakpoint->maxLogsPerSecond) {
+    breakpoint->suppressedLogCount++;
+    return false;
+  }
+  breakpoint->logWindowCount++;
+  return true;
+}
+
+static bool checkCondition(Breakpoint* breakpoint, SEXP env) {
+  if (breakpoint->condition.empty()) {
     return true;
   }
+  if (!breakpoint->conditionError.empty()) {
+    return false;
+  }
+  SHIELD(env);
   try {
     WithDebuggerEnabled with(false);
-    ShieldSEXP expr = parseCode(condition);
-    ShieldSEXP result = RI->asLogical(RI->evalq(expr, env));
-    return asBool(result);
+    ShieldSEXP result = safeEval(breakpoint->conditionExpr, env);
+    return Rf_asLogical(result) == TRUE;
   } catch (RError const&) {
     return false;
   }
 }
 
-static void evaluateAndLog(std::string const& expression, SEXP env) {
-  SHIELD(env);
-  if (expression.empty()) {
-    return;
+static std::string evaluateForLog(Breakpoint* breakpoint, SEXP env) {
+  if (breakpoint->evaluateAndLog.empty()) {
+    return "";
+  }
+  if (!breakpoint->evaluateAndLogError.empty()) {
+    return breakpoint->evaluateAndLogError;
   }
+  SHIELD(env);
   try {
     WithDebuggerEnabled with(false);
-    ShieldSEXP expr = parseCode(expression);
-    rpiService->writeToReplOutputHandler(getPrintedValue(RI->evalq(expr, env)), STDERR);
+    return getPrintedValue(safeEval(breakpoint->evaluateAndLogExpr, env));
   } catch (RError const& e) {
-    rpiService->writeToReplOutputHandler(e.what(), STDERR);
+    return e.what();
+  }
+}
+
+static void evaluateAndLog(Breakpoint* breakpoint, SEXP env) {
+  std::string value = evaluateForLog(breakpoint, env);
+  if (!value.empty()) {
+    rpiService->writeToReplOutputHandler(value, STDERR);
   }
 }
 
@@ -240,18 +346,119 @@ static void printStack(std::vector<RDebuggerStackFrame> const& stack) {
   }
 }
 
+static std::string getPositionText(VirtualFileInfo* file, int line) {
+  static const std::string localFilePrefix = "rlocal:";
+  std::string name = file->id;
+  if (file->isGenerated && !file->generatedName.empty()) {
+    name = file->generatedName;
+  } else if (name.compare(0, localFilePrefix.size(), localFilePrefix) == 0) {
+    name = name.substr(localFilePrefix.size());
+  }
+  return name + ":" + std::to_string(line + 1);
+}
+
+static std::string getStackText(std::vector<RDebuggerStackFrame> const& stack) {
+  std::string text;
+  for (int i = stack.size() - 1; i >= 0; --i) {
+    text += "  " + std::to_string(stack.size() - i) + ": ";
+    if (stack[i].functionName.empty()) {
+      text += i == 0 ? "[global]" : "[anonymous]";
+    } else {
+      text += stack[i].functionName;
+    }
+    if (!stack[i].fileId.empty()) {
+      VirtualFileInfoPtr file = sourceFileManager.getVirtualFileById(stack[i].fileId);
+      text += " (" + (file.isNull() ? stack[i].fileId : getPositionText(&*file, stack[i].line)) + ")";
+    }
+    text += "\n";
+  }
+  return text;
+}
+
+void RDebugger::logBreakpointHit(Breakpoint* breakpoint, std::string const& position, SEXP expr, SEXP env) {
+  LogpointHit hit;
+  hit.time = std::chrono::system_clock::now();
+  hit.position = position;
+  hit.suppressedCount = breakpoint->suppressedLogCount;
+  breakpoint->suppressedLogCount = 0;
+  // Note: the value is evaluated first since the evaluation might log other hits and drop the stored stacks
+  hit.value = evaluateForLog(breakpoint, env);
+  if (breakpoint->printStack) {
+    // Note: the stack is built only for a new key since it looks up sources and deparses calls
+    auto contexts = getContextDump(expr);
+    std::vector<PrSEXP> key;
+    key.reserve(contexts.size() * 3);
+    for (auto const& ctx : contexts) {
+      key.push_back(ctx.call);
+      key.push_back(ctx.function);
+      key.push_back(ctx.srcref);
+    }
+    hit.stackId = logpointBuffer.findStack(key);
+    if (hit.stackId == -1) {
+      hit.stackId = logpointBuffer.putStack(std::move(key), getStackText(buildStack(contexts)));
+    }
+  }
+  logpointBuffer.add(std::move(hit));
+}
+
+void RDebugger::flushLogpoints() {
+  logpointBuffer.flush();
+}
+
+void RDebugger::flushStaleLogpoints() {
+  logpointBuffer.flushIfStale();
+}
+
 void RDebugger::sendDebugPrompt(SEXP currentExpr) {
+  flushLogpoints();
   setCommand(CONTINUE);
   stack = buildStack(getContextDump(currentExpr));
   runToPositionTarget = {R_NilValue, 0};
   rpiService->debugPromptHandler();
+  updateBytecode();
   if (currentCommand == ABORT) {
     setCommand(CONTINUE);
     throw RInterruptedException();
   }
 }
 
+// Direct-mapped cache of srcrefs which were checked for breakpoints since the last change of breakpoints.
+// Note: srcref may be collected and its address reused, so the srcfile and the first line are compared as well
+struct SrcrefCacheEntry {
+  SEXP srcref = nullptr;
+  SEXP srcfile = nullptr;
+  int firstLine = 0;
+  int breakpointsVersion = -1;
+  bool mayHitBreakpoint = false;
+};
+
+static const int SRCREF_CACHE_SIZE = 4096;
+static SrcrefCacheEntry srcrefCache[SRCREF_CACHE_SIZE];
+
+bool RDebugger::mayHitBreakpoint(SEXP srcref) {
+  if (breakpointsMuted || breakpoints.empty() || srcref == R_NilValue) return false;
+  SrcrefCacheEntry& entry = srcrefCache[((uintptr_t)srcref >> 4U) & (SRCREF_CACHE_SIZE - 1)];
+  SEXP srcfile = Rf_getAttrib(srcref, RI->srcfileAttr);
+  int firstLine = INTEGER(srcref)[0];
+  if (entry.srcref == srcref && entry.srcfile == srcfile && entry.firstLine == firstLine &&
+      entry.breakpointsVersion == breakpointsVersion) {
+    return entry.mayHitBreakpoint;
+  }
+  auto position = getPosition(srcref);
+  VirtualFileInfo* virtualFile = position.first;
+  int line = position.second;
+  bool result = virtualFile != nullptr && virtualFile->breakpointCount > 0 &&
+      line < virtualFile->breakpointsByLine.size() && !virtualFile->breakpointsByLine[line].empty() &&
+      Rf_getAttrib(srcref, RI->noBreakpointFlag) == R_NilValue;
+  entry = {srcref, srcfile, firstLine, breakpointsVersion, result};
+  return result;
+}
+
 SEXP RDebugger::doStep(SEXP expr, SEXP env, SEXP srcref, bool alwaysStop, RContext *callContext) {
+  if (currentCommand == CONTINUE && !alwaysStop && !mayHitBreakpoint(srcref)) {
+    // Note: fast path, nothing to do here unless the debugger is stepping or there is a breakpoint on this line
+    return Rf_eval(expr, env);
+  }
   bool suspend = false;
   if (rDebugger.isEnabled()) {
     auto position = getPosition(srcref);
@@ -298,18 +505,34 @@ SEXP RDebugger::doStep(SEXP expr, SEXP env, SEXP srcref, bool alwaysStop, RConte
     if (!breakpointsMuted && breakpoint != nullptr && breakpoint->enabled && (breakpoint->master == nullptr || breakpoint->masterWasHit) &&
         Rf_getAttrib(srcref, RI->noBreakpointFlag) == R_NilValue) {
       CPP_BEGIN
-        if (checkCondition(breakpoint->condition, env)) {
+        if (checkHitPolicy(breakpoint) && checkCondition(breakpoint, env)) {
           if (!breakpoint->slaveLeaveEnabled) breakpoint->masterWasHit = false;
           for (Breakpoint *slave : breakpoint->slaves) {
             slave->masterWasHit = true;
           }
-          if (breakpoint->hitMessage) {
-            printHitMessage(virtualFile, line);
-          }
-          if (breakpoint->printStack) {
-            printStack(buildStack(getContextDump(expr)));
+          bool isLogged = (!breakpoint->hitMessage && !breakpoint->printStack && breakpoint->evaluateAndLog.empty()) ||
+              checkLogRate(breakpoint);
+          if (isLogged && !breakpoint->suspend) {
+            // Note: hits of non-suspending breakpoints are buffered, the output is written in batches
+            if (breakpoint->hitMessage || breakpoint->printStack || !breakpoint->evaluateAndLog.empty()) {
+              logBreakpointHit(breakpoint, breakpoint->hitMessage ? getPositionText(virtualFile, line) : "", expr, env);
+            }
+          } else if (isLogged) {
+            // Note: buffered hits happened before this one
+            flushLogpoints();
+            if (breakpoint->suppressedLogCount > 0) {
+              rpiService->writeToReplOutputHandler(
+                  "\n[" + std::to_string(breakpoint->suppressedLogCount) + " breakpoint hits were not logged]\n", STDERR);
+              breakpoint->suppressedLogCount = 0;
+            }
+            if (breakpoint->hitMessage) {
+              printHitMessage(virtualFile, line);
+            }
+            if (breakpoint->printStack) {
+              printStack(buildStack(getContextDump(expr)));
+            }
+            evaluateAndLog(breakpoint, env);
           }
-          evaluateAndLog(breakpoint->evaluateAndLog, env);
           if (breakpoint->suspend) {
             suspend = true;
           }
@@ -535,17 +758,71 @@ void RDebugger::resetLastErrorStack() {
   lastErrorStackDump.clear();
 }
 
-static std::unordered_map<SEXP, int> allBytecode;
+// Note: bytecode is "poisoned" by replacing its version with an invalid one, so R falls back to the AST interpreter.
+// The original version is saved here and restored when the bytecode is not needed to be interpreted anymore.
+// The source range of the bytecode is collected once when it's needed for the first time (i.e. in selective mode),
+// so updates only intersect it with breakpoints and sessions which never use selective mode don't walk the AST at all.
+// Its srcfile is reachable from the bytecode's srcrefs, so it lives as long as the entry
+struct BytecodeInfo {
+  int savedVersion = 0;
+  bool isRangeCollected = false;
+  SEXP srcfile = R_NilValue;
+  int firstLine = INT_MAX;  // Note: relative to the srcfile
+  int lastLine = -1;
+};
+
+static std::unordered_map<SEXP, BytecodeInfo> allBytecode;
 static bool bytecodeEnabled = true;
+static bool selectiveBytecode = false;
+
+static const char* SELECTIVE_BYTECODE_OPTION = "jetbrains.debugger.selective.bytecode";
+
+static void setPoisoned(std::pair<const SEXP, BytecodeInfo>& entry, bool poisoned) {
+  int* code = INTEGER(BCODE_CODE(entry.first));
+  if (poisoned && code[0] != INT_MAX) {
+    entry.second.savedVersion = code[0];
+    code[0] = INT_MAX;
+  } else if (!poisoned && code[0] == INT_MAX) {
+    code[0] = entry.second.savedVersion;
+  }
+}
+
+static void collectSourceRange(SEXP expr, BytecodeInfo& info) {
+  if (TYPEOF(expr) != LANGSXP) return;
+  if (CAR(expr) == RI->functionSymbol) return;  // Note: nested functions are compiled separately
+  if (ATTRIB(expr) != R_NilValue) {
+    SEXP srcrefs = getBlockSrcrefs(expr);
+    for (int i = 0; i < Rf_length(srcrefs); ++i) {
+      SEXP srcref = getSrcref(srcrefs, i);
+      if (srcref == R_NilValue) continue;
+      SEXP srcfile = Rf_getAttrib(srcref, RI->srcfileAttr);
+      if (srcfile == R_NilValue) continue;
+      if (info.srcfile == R_NilValue) info.srcfile = srcfile;
+      if (info.srcfile != srcfile) continue;
+      info.firstLine = std::min(info.firstLine, INTEGER(srcref)[0] - 1);
+      info.lastLine = std::max(info.lastLine, INTEGER(srcref)[2] - 1);
+    }
+  }
+  for (SEXP args = CDR(expr); args != R_NilValue; args = CDR(args)) {
+    collectSourceRange(CAR(args), info);
+  }
+}
+
+static bool shouldPoison(std::pair<const SEXP, BytecodeInfo>& entry) {
+  if (bytecodeEnabled) return false;
+  if (!selectiveBytecode) return true;
+  BytecodeInfo& info = entry.second;
+  if (!info.isRangeCollected) {
+    collectSourceRange(BCODE_EXPR(entry.first), info);
+    info.isRangeCollected = true;
+  }
+  return rDebugger.isInterpreterRequired(info.srcfile, info.firstLine, info.lastLine);
+}
+
 static void registerBytecode(SEXP bytecode) {
   if (allBytecode.count(bytecode)) return;
-  if (bytecodeEnabled) {
-    allBytecode[bytecode] = 0;
-  } else {
-    SEXP code = BCODE_CODE(bytecode);
-    allBytecode[bytecode] = INTEGER(code)[0];
-    INTEGER(code)[0] = INT_MAX;
-  }
+  auto& entry = *allBytecode.insert({bytecode, BytecodeInfo()}).first;
+  setPoisoned(entry, shouldPoison(entry));
   if (isOldR()) {
     ShieldSEXP s = Rf_install("fin");
     Rf_setAttrib(bytecode, s, createFinalizer([bytecode]() { allBytecode.erase(bytecode); }));
@@ -585,14 +862,20 @@ void RDebugger::setBytecodeEnabled(bool enabled) {
   if (enabled == bytecodeEnabled) return;
   static PrSEXP prevJIT;
   if (enabled) {
-    for (auto const& p : allBytecode) {
-      SEXP bytecode = p.first;
-      INTEGER(BCODE_CODE(bytecode))[0] = p.second;
+    bytecodeEnabled = true;
+    for (auto& p : allBytecode) {
+      setPoisoned(p, false);
+    }
+    if (!selectiveBytecode) {
+      RI->compilerEnableJIT(prevJIT);
+      prevJIT = R_NilValue;
     }
-    RI->compilerEnableJIT(prevJIT);
-    prevJIT = R_NilValue;
   } else {
-    prevJIT = RI->compilerEnableJIT(0);
+    selectiveBytecode = asBool(RI->getOption(SELECTIVE_BYTECODE_OPTION));
+    if (!selectiveBytecode) {
+      // Note: in selective mode JIT stays enabled since new bytecode is poisoned on registration if necessary
+      prevJIT = RI->compilerEnableJIT(0);
+    }
     static bool firstTime = true;
     if (firstTime) {
       firstTime = false;
@@ -604,13 +887,45 @@ void RDebugger::setBytecodeEnabled(bool enabled) {
         if (TYPEOF(x) == BCODESXP) registerBytecode(x);
       }, Rf_list2(R_GlobalEnv, R_NamespaceRegistry));
     }
-    for (auto &p : allBytecode) {
-      SEXP code = BCODE_CODE(p.first);
-      p.second = INTEGER(code)[0];
-      INTEGER(code)[0] = INT_MAX;
+    bytecodeEnabled = false;
+    rDebugger.bytecodeBreakpointsVersion = rDebugger.breakpointsVersion;
+    rDebugger.isBytecodeStepping = rDebugger.currentCommand != CONTINUE;
+    for (auto& p : allBytecode) {
+      setPoisoned(p, shouldPoison(p));
+    }
+  }
+}
+
+void RDebugger::updateBytecode() {
+  if (bytecodeEnabled || !selectiveBytecode) return;
+  bool isStepping = currentCommand != CONTINUE;
+  if (isStepping == isBytecodeStepping && breakpointsVersion == bytecodeBreakpointsVersion) return;
+  isBytecodeStepping = isStepping;
+  bytecodeBreakpointsVersion = breakpointsVersion;
+  for (auto& p : allBytecode) {
+    setPoisoned(p, shouldPoison(p));
+  }
+}
+
+bool RDebugger::isInterpreterRequired(SEXP srcfile, int firstLine, int lastLine) {
+  // Note: stepping may enter any function, so everything is interpreted until the next "continue"
+  if (currentCommand != CONTINUE) return true;
+  if (breakpointsMuted || breakpoints.empty()) return false;
+  if (srcfile == R_NilValue) return false;
+  SEXP virtualFilePtr = Rf_getAttrib(srcfile, RI->virtualFilePtrAttr);
+  if (TYPEOF(virtualFilePtr) != EXTPTRSXP) return false;
+  auto file = (VirtualFileInfo*)R_ExternalPtrAddr(virtualFilePtr);
+  if (file == nullptr || file->breakpointCount == 0) return false;
+  int lineOffset = asInt(Rf_getAttrib(srcfile, RI->lineOffsetAttr));
+  auto const& breakpointsByLine = file->breakpointsByLine;
+  int first = std::max(firstLine + lineOffset, 0);
+  int last = std::min(lastLine + lineOffset, (int)breakpointsByLine.size() - 1);
+  for (int line = first; line <= last; ++line) {
+    for (Breakpoint* breakpoint : breakpointsByLine[line]) {
+      if (breakpoint->enabled) return true;
     }
   }
-  bytecodeEnabled = enabled;
+  return false;
 }
 
 static void overrideDoEval(bool enabled) {
@@ -18,6 +18,7 @@
 #ifndef RWRAPPER_R_DEBUGGER_H
 #define RWRAPPER_R_DEBUGGER_H
 
+#include <chrono>
 #include <string>
 #include <unordered_map>
 #include <map>
@@ -25,6 +26,7 @@
 #undef Free
 #include "../RInternals/RInternals.h"
 #include "../RStuff/MySEXP.h"
+#include "LogpointBuffer.h"
 #include "protos/service.grpc.pb.h"
 
 using namespace rplugininterop;
@@ -57,10 +59,25 @@ struct Breakpoint {
   bool suspend = true;
   std::string evaluateAndLog;
   std::string condition;
+  // Parsed once when the breakpoint is modified, error is non-empty if the code can't be parsed
+  PrSEXP evaluateAndLogExpr = R_NilValue;
+  PrSEXP conditionExpr = R_NilValue;
+  std::string evaluateAndLogError;
+  std::string conditionError;
   bool hitMessage = false;
   bool printStack = false;
   bool removeAfterHit = false;
 
+  // Hit policies are checked natively before the condition, zero means that the policy is not used
+  int hitNumber = 0;  // Hit only on the N-th pass
+  int hitModulo = 0;  // Hit on every K-th pass
+  int firstHits = 0;  // Hit only on the first N passes
+  int maxLogsPerSecond = 0;  // Hits above the limit suspend (if needed) but don't log anything
+  int passCount = 0;
+  std::chrono::steady_clock::time_point logWindowStart;
+  int logWindowCount = 0;
+  int suppressedLogCount = 0;
+
   Breakpoint* master = nullptr;
   bool slaveLeaveEnabled = false;
   std::vector<Breakpoint*> slaves;
@@ -78,11 +95,14 @@ public:
   bool isEnabled();
   static void setBytecodeEnabled(bool enabled);
   static bool isBytecodeEnabled();
+  void updateBytecode();
+  bool isInterpreterRequired(SEXP srcfile, int firstLine, int lastLine);
 
   void addOrModifyBreakpoint(DebugAddOrModifyBreakpointRequest const& request);
   void removeBreakpointById(int id);
   Breakpoint* getBreakpointById(int id);
   void setMasterBreakpoint(Breakpoint* breakpoint, Breakpoint* newMaster, bool leaveEnabled);
+  void setBreakpointHitPolicy(int id, int hitNumber, int hitModulo, int firstHits, int maxLogsPerSecond);
   void muteBreakpoints(bool mute);
 
   SEXP doBegin(SEXP call, SEXP op, SEXP args, SEXP rho);
@@ -90,6 +110,8 @@ public:
   void doHandleException(SEXP e);
   void buildDebugPrompt(AsyncEvent::DebugPrompt* prompt);
   void sendDebugPrompt(SEXP currentExpr);
+  void flushLogpoints();
+  void flushStaleLogpoints();
 
   std::vector<RDebuggerStackFrame> const& getSavedStack();
   std::vector<RDebuggerStackFrame> getLastErrorStack();
@@ -105,6 +127,9 @@ public:
 private:
   volatile bool _isEnabled = false;
   bool breakpointsMuted = false;
+  int breakpointsVersion = 0;
+  int bytecodeBreakpointsVersion = -1;
+  bool isBytecodeStepping = false;
   int beginOffset;
   FunTabFunction defaultDoBegin;
 
@@ -123,6 +148,11 @@ private:
   std::vector<RDebuggerStackFrame> stack;
   std::vector<ContextDump> lastErrorStackDump;
 
+  LogpointBuffer logpointBuffer;
+
+  bool mayHitBreakpoint(SEXP srcref);
+  void logBreakpointHit(Breakpoint* breakpoint, std::string const& position, SEXP expr, SEXP env);
+
   std::vector<ContextDump> getContextDump(SEXP currentCall);
   std::vector<ContextDump> getContextDumpErr();
   static std::vector<RDebuggerStackFrame> buildStack(std::vector<ContextDump> const& contexts);
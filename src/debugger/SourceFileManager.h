@@ -52,6 +52,7 @@ struct VirtualFileInfo {
   bool isGenerated = false;
   std::string generatedName;
   std::vector<std::vector<Breakpoint*>> breakpointsByLine;
+  int breakpointCount = 0;
 
   /*
    * Content of the file. Designed for getting text of generated files,
@@ -0,0 +1,114 @@
+//  Rkernel is an execution kernel for R interpreter
+//  Copyright (C) 2019 JetBrains s.r.o.
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+
+#ifndef RWRAPPER_ARENA_H
+#define RWRAPPER_ARENA_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "Ptr.h"
+
+namespace graphics {
+
+/**
+ * Monotonic memory arena: allocations are bumped out of large chunks
+ * and the memory is released all at once when the arena is destroyed.
+ * **Note:** nothing is freed individually, so a single surviving object (or container)
+ * allocated from the arena pins all of its chunks.
+ * **Note:** it's not thread-safe
+ */
+class Arena {
+private:
+  static const size_t CHUNK_SIZE = 64 * 1024;
+
+  std::vector<std::unique_ptr<char[]>> chunks;
+  char* current = nullptr;
+  size_t left = 0;
+
+public:
+  Arena() = default;
+  Arena(const Arena&) = delete;
+  Arena& operator=(const Arena&) = delete;
+
+  void* allocate(size_t size, size_t alignment) {
+    auto padding = (alignment - reinterpret_cast<uintptr_t>(current) % alignment) % alignment;
+    if (current == nullptr || padding + size > left) {
+      // Note: oversized requests get a chunk of their own
+      auto chunkSize = std::max(CHUNK_SIZE, size + alignment);
+      chunks.emplace_back(new char[chunkSize]);
+      current = chunks.back().get();
+      left = chunkSize;
+      padding = (alignment - reinterpret_cast<uintptr_t>(current) % alignment) % alignment;
+    }
+    auto result = current + padding;
+    current += padding + size;
+    left -= padding + size;
+    return result;
+  }
+};
+
+/**
+ * STL-compatible allocator on top of `Arena`. It shares the ownership of the arena,
+ * so objects allocated with `std::allocate_shared()` keep their memory alive
+ * even after the arena's creator has gone
+ */
+template<typename T>
+class ArenaAllocator {
+private:
+  Ptr<Arena> arena;
+
+  template<typename U>
+  friend class ArenaAllocator;
+
+public:
+  using value_type = T;
+
+  explicit ArenaAllocator(Ptr<Arena> arena) : arena(std::move(arena)) {}
+
+  template<typename U>
+  ArenaAllocator(const ArenaAllocator<U>& other) : arena(other.arena) {}
+
+  T* allocate(size_t count) {
+    return static_cast<T*>(arena->allocate(count * sizeof(T), alignof(T)));
+  }
+
+  void deallocate(T*, size_t) {
+    // Note: the memory is released along with the arena
+  }
+
+  template<typename U>
+  bool operator==(const ArenaAllocator<U>& other) const {
+    return arena == other.arena;
+  }
+
+  template<typename U>
+  bool operator!=(const ArenaAllocator<U>& other) const {
+    return arena != other.arena;
+  }
+};
+
+template<typename T>
+using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+
+}  // graphics
+
+#endif //RWRAPPER_ARENA_H
@@ -62,4 +62,15 @@ SEXP Evaluator::evaluate(const std::string &command, ScopeProtector *protector)
   return evaluateExpression(createExpressionSexp(command, protector), protector);
 }
 
+bool Evaluator::evaluateCall(const std::string &functionCommand, SEXP argument) {
+  DEVICE_TRACE;
+  ScopeProtector protector;
+  auto functionSexp = VECTOR_ELT(createExpressionSexp(functionCommand, &protector), 0);
+  auto callSexp = Rf_lang2(functionSexp, argument);
+  protector.add(callSexp);
+  auto errorCode = 0;
+  R_tryEval(callSexp, R_GlobalEnv, &errorCode);
+  return errorCode == 0;
+}
+
 }  // graphics
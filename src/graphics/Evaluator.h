@@ -28,6 +28,10 @@ class Evaluator {
 public:
   static void evaluate(const std::string &command);
   static SEXP evaluate(const std::string &command, ScopeProtector *protector);
+
+  // Evaluate `function(argument)` where `function` is a result of `functionCommand`.
+  // Returns `false` if the evaluation has failed
+  static bool evaluateCall(const std::string &functionCommand, SEXP argument);
 };
 
 }  // graphics
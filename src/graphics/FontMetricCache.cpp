@@ -0,0 +1,90 @@
+//  Rkernel is an execution kernel for R interpreter
+//  Copyright (C) 2019 JetBrains s.r.o.
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+
+#include "FontMetricCache.h"
+
+#include <cstring>
+
+namespace graphics {
+
+namespace {
+
+const auto MAX_ENTRY_COUNT = 100000U;  // Note: the whole map is dropped when exceeded
+
+template<typename T>
+void appendValue(std::string& key, T value) {
+  key.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template<typename TValue>
+void putBounded(std::unordered_map<std::string, TValue>& key2Values, const std::string& key, TValue value) {
+  if (key2Values.size() >= MAX_ENTRY_COUNT) {
+    key2Values.clear();
+  }
+  key2Values[key] = value;
+}
+
+}  // anonymous
+
+FontMetricCache* FontMetricCache::getInstance() {
+  static auto instance = new FontMetricCache();
+  return instance;
+}
+
+const std::string& FontMetricCache::makeKey(pGEcontext context, int resolution, const char* text, int character) {
+  key.clear();
+  key.append(context->fontfamily, strnlen(context->fontfamily, sizeof(context->fontfamily)));
+  key.push_back('\0');
+  appendValue(key, context->fontface);
+  appendValue(key, context->ps * context->cex);
+  appendValue(key, resolution);
+  if (text != nullptr) {
+    key.append(text);
+  } else {
+    appendValue(key, character);
+  }
+  return key;
+}
+
+bool FontMetricCache::findMetricInfo(pGEcontext context, int resolution, int character, MetricInfo& metricInfo) {
+  auto it = key2MetricInfos.find(makeKey(context, resolution, nullptr, character));
+  if (it != key2MetricInfos.end()) {
+    metricInfo = it->second;
+    return true;
+  }
+  return false;
+}
+
+void FontMetricCache::putMetricInfo(pGEcontext context, int resolution, int character, MetricInfo metricInfo) {
+  putBounded(key2MetricInfos, makeKey(context, resolution, nullptr, character), metricInfo);
+}
+
+bool FontMetricCache::findStringWidth(pGEcontext context, int resolution, const char* text, double& width) {
+  auto it = key2Widths.find(makeKey(context, resolution, text, 0));
+  if (it != key2Widths.end()) {
+    width = it->second;
+    return true;
+  }
+  return false;
+}
+
+void FontMetricCache::putStringWidth(pGEcontext context, int resolution, const char* text, double width) {
+  putBounded(key2Widths, makeKey(context, resolution, text, 0), width);
+}
+
+}  // graphics
@@ -0,0 +1,64 @@
+//  Rkernel is an execution kernel for R interpreter
+//  Copyright (C) 2019 JetBrains s.r.o.
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+
+#ifndef RWRAPPER_FONTMETRICCACHE_H
+#define RWRAPPER_FONTMETRICCACHE_H
+
+#include <string>
+#include <unordered_map>
+
+#include "Rinternals.h"
+#undef length
+#include <R_ext/GraphicsEngine.h>
+
+namespace graphics {
+
+struct MetricInfo {
+  double ascent;
+  double descent;
+  double width;
+};
+
+/**
+ * Process-wide cache of character metrics and string widths reported by slave devices.
+ * They depend only on the font (family, face and size), on the device's resolution and on the queried text,
+ * so the results can be shared by all replays and rescales, including the ones on the proxy device.
+ * **Note:** must be used from the main R thread only
+ */
+class FontMetricCache {
+private:
+  std::unordered_map<std::string, MetricInfo> key2MetricInfos;
+  std::unordered_map<std::string, double> key2Widths;
+  std::string key;  // Note: reused in order to avoid allocations on lookups
+
+  FontMetricCache() = default;
+
+  const std::string& makeKey(pGEcontext context, int resolution, const char* text, int character);
+
+public:
+  static FontMetricCache* getInstance();
+
+  bool findMetricInfo(pGEcontext context, int resolution, int character, MetricInfo& metricInfo);
+  void putMetricInfo(pGEcontext context, int resolution, int character, MetricInfo metricInfo);
+  bool findStringWidth(pGEcontext context, int resolution, const char* text, double& width);
+  void putStringWidth(pGEcontext context, int resolution, const char* text, double width);
+};
+
+}  // graphics
+
+#endif //RWRAPPER_FONTMETRICCACHE_H
@@ -19,7 +19,9 @@
 #include <string>
 
 #include "DeviceManager.h"
+#include "SnapshotCache.h"
 #include "../RStuff/Conversion.h"
+#include "../RStuff/MySEXP.h"
 
 using namespace graphics;
 
@@ -99,3 +101,26 @@ SEXP jetbrains_ther_device_rescale_stored(const std::string& parentDirectory, in
     return toSEXP(false);
   }
 }
+
+SEXP jetbrains_ther_device_snapshot_cache_statistics() {
+  auto active = DeviceManager::getInstance()->getActive();
+  if (!active) {
+    std::cerr << "jetbrains_ther_device_snapshot_cache_statistics(): Device is not active. Ignored\n";
+    return R_NilValue;
+  }
+  auto statistics = SnapshotCache::getInstance(active->getSnapshotDirectory())->getStatistics();
+  auto names = std::vector<std::string> {
+    "memory.hits", "disk.hits", "misses", "memory.entries", "memory.bytes", "disk.entries", "disk.bytes"
+  };
+  auto values = std::vector<int64_t> {
+    statistics.memoryHitCount, statistics.diskHitCount, statistics.missCount,
+    statistics.memoryEntryCount, statistics.memoryByteCount, statistics.diskEntryCount, statistics.diskByteCount
+  };
+  ShieldSEXP result = Rf_allocVector(REALSXP, values.size());
+  for (auto i = 0; i < int(values.size()); i++) {
+    REAL(result)[i] = double(values[i]);
+  }
+  ShieldSEXP namesVector = makeCharacterVector(names);
+  Rf_setAttrib(result, R_NamesSymbol, namesVector);
+  return result;
+}
@@ -15,6 +15,7 @@
 //  along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 
+#include <algorithm>
 #include <string.h>
 #include <sstream>
 #include <fstream>
@@ -24,6 +25,9 @@
 #include "MasterDevice.h"
 #include "SlaveDevice.h"
 #include "SnapshotUtil.h"
+#include "SnapshotCache.h"
+#include "SnapshotStore.h"
+#include "RescaleWorkerPool.h"
 #include "REagerGraphicsDevice.h"
 #include "DeviceManager.h"
 #include "PlotUtil.h"
@@ -38,7 +42,19 @@ const auto PROXY_DEVICE_NAME = "TheRPlugin_ProxyDevice";
 
 const auto FIRST_PROXY_SIZE = Size{2570, 1920};
 
-const auto MAX_COMPLEXITY = 500000;  // 500k
+// Note: the IDE usually fetches the same few plots over and over (say, when switching between tabs),
+// so extrapolated plots are memoized only for the most recently fetched ones
+const auto MAX_FETCHED_PLOT_COUNT = 3U;
+
+const auto DENSITY_AGGREGATION_OPTION = "jetbrains.graphics.density.aggregation";
+
+void reportTooComplex(int number, const char* kind) {
+  std::cerr << "Plot #" << number << " is too complex to be fetched";
+  if (kind != nullptr) {
+    std::cerr << " (the complexity budget has been crossed by a " << kind << ")";
+  }
+  std::cerr << "\n";
+}
 
 MasterDevice* masterOf(pDevDesc descriptor) {
   auto masterDevice = MasterDevice::from(descriptor);
@@ -277,7 +293,9 @@ void MasterDevice::clearAllDevices() {
   auto command = SnapshotUtil::makeRemoveVariablesCommand(deviceNumber, 0, currentDeviceInfos.size());
   Evaluator::evaluate(command);
   currentDeviceInfos.clear();
+  fetchedPlotNumbers.clear();
   currentSnapshotNumber = -1;
+  SnapshotCache::getInstance(currentSnapshotDirectory)->clear();  // Note: snapshot numbers are going to be reused
   addNewDevice();  // Note: prevent potential out of range errors
 }
 
@@ -398,7 +416,7 @@ bool MasterDevice::commitByNumber(int number, bool withRescale, ScreenParameters
   if (!device->isBlank()) {
     recordAndDumpIfNecessary(deviceInfo, number);
     if (withRescale) {
-      rescaleAndDumpIfNecessary(deviceInfo, newParameters);
+      rescaleAndDumpIfNecessary(deviceInfo, number, newParameters);
     }
     return true;
   } else {
@@ -406,7 +424,9 @@ bool MasterDevice::commitByNumber(int number, bool withRescale, ScreenParameters
   }
 }
 
-bool MasterDevice::rescaleByPath(const std::string& parentDirectory, int number, int version, ScreenParameters newParameters) {
+bool MasterDevice::loadStored(const std::string& parentDirectory, int number, ScreenParameters newParameters,
+                              ScopeProtector* protector, SEXP& plot)
+{
   if (!masterDeviceDescriptor) {
     return false;
   }
@@ -416,19 +436,82 @@ bool MasterDevice::rescaleByPath(const std::string& parentDirectory, int number,
     return false;
   }
 
+  auto store = SnapshotStore::getInstance(parentDirectory);
+  auto isStored = store->contains(number);
+  if (isStored) {
+    plot = store->get(number, protector);
+  }
+  if (parentDirectory != currentSnapshotDirectory) {
+    // Note: nothing is written to a directory of another session, so its store would only
+    // hold a writer thread and a stale index
+    store.reset();
+    SnapshotStore::close(parentDirectory);
+  }
+  if (isStored) {
+    if (plot == R_NilValue) {
+      std::cerr << "Cannot restore recorded plot. Ignored\n";
+      return false;
+    }
+    return true;
+  }
+
+  // Note: snapshot directories created by older versions contain a separate file for each recorded plot.
+  // It will be loaded by R on replay
   auto path = SnapshotUtil::makeRecordedFilePath(parentDirectory, number);
   if (!std::ifstream(path)) {
     std::cerr << "No corresponding recorded file. Ignored\n";
     return false;
   }
+  plot = R_NilValue;
+  return true;
+}
 
+bool MasterDevice::replayStoredAndDump(const std::string& parentDirectory, int number, int version,
+                                       ScreenParameters newParameters, SEXP plot)
+{
   auto device = makePtr<REagerGraphicsDevice>(parentDirectory, deviceNumber, number, version + 1, newParameters, inMemory, isProxy);
-  device->replayFromFile(parentDirectory, number);
-  device->dump();
+  if (plot != R_NilValue) {
+    if (!device->replayRecorded(plot)) {
+      std::cerr << "Cannot replay recorded plot #" << number << ". Ignored\n";
+      return false;
+    }
+  } else {
+    device->replayFromFile(parentDirectory, number);
+  }
+  return device->dump();
+}
 
+bool MasterDevice::rescaleByPath(const std::string& parentDirectory, int number, int version, ScreenParameters newParameters) {
+  auto cache = SnapshotCache::getInstance(parentDirectory);
+  auto key = SnapshotKey::make(number, SnapshotType::NORMAL, newParameters);
+  auto path = makeSnapshotPath(parentDirectory, SnapshotType::NORMAL, number, version + 1, newParameters.resolution);
+  if (cache->restore(key, path)) {
+    return true;
+  }
+  ScopeProtector protector;
+  auto plot = R_NilValue;
+  if (!loadStored(parentDirectory, number, newParameters, &protector, plot)) {
+    return false;
+  }
+  if (replayStoredAndDump(parentDirectory, number, version, newParameters, plot)) {
+    cache->put(key, path);
+  }
   return true;
 }
 
+int MasterDevice::launchRescaleByPath(const std::string& parentDirectory, int number, int version, ScreenParameters newParameters) {
+  // Note: the plot is loaded before forking since the worker must not touch the snapshot store
+  // whose writer thread doesn't exist in a child process
+  ScopeProtector protector;
+  auto plot = R_NilValue;
+  if (!loadStored(parentDirectory, number, newParameters, &protector, plot)) {
+    return -1;
+  }
+  return RescaleWorkerPool::forkWorker([&] {
+    return replayStoredAndDump(parentDirectory, number, version, newParameters, plot);
+  });
+}
+
 std::vector<int> MasterDevice::dumpAllLast() {
   return commitAllLast(false, ScreenParameters{});
 }
@@ -436,21 +519,55 @@ std::vector<int> MasterDevice::dumpAllLast() {
 Plot MasterDevice::fetchPlot(int number) {
   // Make sure this plot is not too complex
   // (otherwise it won't be possible to pass it via gRPC)
-  auto totalComplexity = getDeviceAt(number)->estimatedComplexity();
-  if (totalComplexity > MAX_COMPLEXITY) {
+  auto device = getDeviceAt(number);
+  auto totalComplexity = device->estimatedComplexity();
+  if (totalComplexity > MAX_PLOT_COMPLEXITY) {
+    reportTooComplex(number, device->overComplexityBudgetKind());
     return PlotUtil::createPlotWithError(PlotError::TOO_COMPLEX);
   }
 
+  // Note: a dumped plot never changes, so the extrapolated one can be reused by subsequent fetches
+  // unless the options affecting extrapolation have been changed
+  auto isDensityAggregationEnabled = Rf_asLogical(Rf_GetOption1(Rf_install(DENSITY_AGGREGATION_OPTION))) == TRUE;
+  auto& deviceInfo = currentDeviceInfos[number];
+  if (deviceInfo.fetchedPlot && deviceInfo.isFetchedPlotAggregated == isDensityAggregationEnabled) {
+    return *deviceInfo.fetchedPlot;
+  }
+
   // Replay plot on the proxy device in order to extrapolate
   auto firstDevice = replayOnProxy(number, FIRST_PROXY_SIZE);
+  if (firstDevice->isOverComplexityBudget()) {
+    // Note: the estimation of the master device might be stale (say, for plots replayed from a file)
+    reportTooComplex(number, firstDevice->overComplexityBudgetKind());
+    DeviceManager::getInstance()->getProxy()->clearAllDevices();
+    return PlotUtil::createPlotWithError(PlotError::TOO_COMPLEX);
+  }
   auto secondDevice = replayOnProxy(number, FIRST_PROXY_SIZE * 2);
+  auto& styles = deviceInfo.styles;
+  if (!styles) {
+    styles = makePtr<StyleRegistry>();
+  }
   auto plot = PlotUtil::extrapolate(firstDevice->logicSizeInInches(), firstDevice->recordedActions(),
-                                    secondDevice->logicSizeInInches(), secondDevice->recordedActions(),
-                                    totalComplexity);
+                                    secondDevice->logicSizeInInches(), secondDevice->recordedActions(), totalComplexity,
+                                    styles, isDensityAggregationEnabled);
   DeviceManager::getInstance()->getProxy()->clearAllDevices();
+  if (deviceInfo.hasDumped && plot.error == PlotError::NONE) {
+    rememberFetchedPlot(deviceInfo, number, plot);
+    deviceInfo.isFetchedPlotAggregated = isDensityAggregationEnabled;
+  }
   return plot;
 }
 
+void MasterDevice::rememberFetchedPlot(DeviceInfo& deviceInfo, int number, const Plot& plot) {
+  deviceInfo.fetchedPlot = makePtr<Plot>(plot);
+  fetchedPlotNumbers.erase(std::remove(fetchedPlotNumbers.begin(), fetchedPlotNumbers.end(), number), fetchedPlotNumbers.end());
+  fetchedPlotNumbers.push_back(number);
+  if (fetchedPlotNumbers.size() > MAX_FETCHED_PLOT_COUNT) {
+    currentDeviceInfos[fetchedPlotNumbers.front()].fetchedPlot = nullptr;
+    fetchedPlotNumbers.pop_front();
+  }
+}
+
 Ptr<REagerGraphicsDevice> MasterDevice::replayOnProxy(int number, Size size) {
   auto proxy = DeviceManager::getInstance()->getProxy();
   proxy->currentScreenParameters.size = size;
@@ -653,25 +770,46 @@ void MasterDevice::recordAndDumpIfNecessary(DeviceInfo &deviceInfo, int number)
     record(deviceInfo, number);
   }
   if (!deviceInfo.hasDumped) {
-    dumpNormal(deviceInfo);
+    dumpNormal(deviceInfo, number);
   }
 }
 
-void MasterDevice::rescaleAndDumpIfNecessary(DeviceInfo& deviceInfo, ScreenParameters newParameters) {
+void MasterDevice::rescaleAndDumpIfNecessary(DeviceInfo& deviceInfo, int number, ScreenParameters newParameters) {
   auto previousParameters = deviceInfo.device->logicScreenParameters();
   if (!deviceInfo.hasRescaled || !isClose(previousParameters, newParameters)) {
-    rescaleAndDump(deviceInfo.device, SnapshotType::NORMAL, newParameters);
+    rescaleAndDump(deviceInfo.device, number, SnapshotType::NORMAL, newParameters);
     deviceInfo.hasRescaled = true;
   }
 }
 
-void MasterDevice::rescaleAndDump(const Ptr<REagerGraphicsDevice>& device, SnapshotType type, ScreenParameters newParameters) {
+bool MasterDevice::isSnapshotCacheEnabled() {
+  return !inMemory && !isProxy;
+}
+
+std::string MasterDevice::makeSnapshotPath(const std::string& directory, SnapshotType type, int number, int version, int resolution) {
+  return directory + "/" + SnapshotUtil::makeSnapshotName(type, number, version, resolution);
+}
+
+void MasterDevice::rescaleAndDump(const Ptr<REagerGraphicsDevice>& device, int number, SnapshotType type, ScreenParameters newParameters) {
+  auto cache = SnapshotCache::getInstance(currentSnapshotDirectory);
+  auto key = SnapshotKey::make(number, type, newParameters);
+  auto path = makeSnapshotPath(currentSnapshotDirectory, type, number, device->currentVersion() + 1, newParameters.resolution);
+  if (isSnapshotCacheEnabled() && cache->restore(key, path)) {
+    // Note: the plot has been rendered with these parameters before, so just bump its version.
+    // Nothing will be drawn since there is no replay
+    device->rescale(type, newParameters);
+    device->dump();
+    return;
+  }
   device->rescale(type, newParameters);
   device->replay();
   device->dump();
+  if (isSnapshotCacheEnabled()) {
+    cache->put(key, path);
+  }
 }
 
-void MasterDevice::dumpNormal(DeviceInfo &deviceInfo) {
+void MasterDevice::dumpNormal(DeviceInfo &deviceInfo, int number) {
   auto device = deviceInfo.device;
   if (!device->isOnNewPage()) {
     // Note: commands like `points(...)` don't invoke `newPage()`
@@ -691,13 +829,19 @@ void MasterDevice::dumpNormal(DeviceInfo &deviceInfo) {
   }
   device->dump();
   deviceInfo.hasDumped = true;
+  if (isSnapshotCacheEnabled()) {
+    auto parameters = device->logicScreenParameters();
+    auto path = makeSnapshotPath(currentSnapshotDirectory, SnapshotType::NORMAL, number, device->currentVersion(), parameters.resolution);
+    SnapshotCache::getInstance(currentSnapshotDirectory)->put(SnapshotKey::make(number, SnapshotType::NORMAL, parameters), path);
+  }
 }
 
 void MasterDevice::record(DeviceInfo& deviceInfo, int number) {
   auto recordCommand = SnapshotUtil::makeRecordVariableCommand(deviceNumber, number, deviceInfo.hasGgPlot);
   Evaluator::evaluate(recordCommand);
-  auto saveCommand = SnapshotUtil::makeSaveVariableCommand(currentSnapshotDirectory, deviceNumber, number);
-  Evaluator::evaluate(saveCommand);
+  ScopeProtector protector;
+  auto plot = Evaluator::evaluate(SnapshotUtil::makeVariableName(deviceNumber, number), &protector);
+  SnapshotStore::getInstance(currentSnapshotDirectory)->put(number, plot);
   deviceInfo.hasRecorded = true;
 }
 
@@ -706,6 +850,8 @@ MasterDevice::~MasterDevice() {
     auto command = SnapshotUtil::makeRemoveVariablesCommand(deviceNumber, 0, currentDeviceInfos.size());
     Evaluator::evaluate(command);
   }
+  SnapshotStore::close(currentSnapshotDirectory);
+  SnapshotCache::close(currentSnapshotDirectory);
   shutdown();
 }
 
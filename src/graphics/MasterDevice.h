@@ -18,12 +18,15 @@
 #ifndef MASTER_DEVICE_H
 #define MASTER_DEVICE_H
 
+#include <deque>
 #include <string>
 
 #include "Ptr.h"
 #include "Plot.h"
 #include "InitHelper.h"
+#include "ScopeProtector.h"
 #include "ScreenParameters.h"
+#include "StyleRegistry.h"
 #include "REagerGraphicsDevice.h"
 
 namespace graphics {
@@ -35,12 +38,16 @@ class MasterDevice {
     bool hasDumped = false;
     bool hasGgPlot = false;
     bool hasRescaled = false;
+    Ptr<StyleRegistry> styles;  // Shared by all fetched versions of this plot
+    Ptr<Plot> fetchedPlot;  // Note: kept only for dumped plots since their contents are final
+    bool isFetchedPlotAggregated = false;
   };
 
   InitHelper initHelper;  // Rollback to previous active GD when this is closed (used in device dtor)
   std::string currentSnapshotDirectory;
   ScreenParameters currentScreenParameters;
   std::vector<DeviceInfo> currentDeviceInfos;
+  std::deque<int> fetchedPlotNumbers;  // Note: the most recently fetched ones go last
   int currentSnapshotNumber;
   bool isNextGgPlot;
   int deviceNumber;
@@ -50,13 +57,20 @@ class MasterDevice {
   pGEDevDesc masterDeviceDescriptor;
 
   void record(DeviceInfo& deviceInfo, int number);
-  static void rescaleAndDump(const Ptr<REagerGraphicsDevice>& device, SnapshotType type, ScreenParameters newParameters);
-  static void rescaleAndDumpIfNecessary(DeviceInfo& deviceInfo, ScreenParameters newParameters);
-  static void dumpNormal(DeviceInfo &deviceInfo);
+  bool isSnapshotCacheEnabled();
+  static std::string makeSnapshotPath(const std::string& directory, SnapshotType type, int number, int version, int resolution);
+  void rescaleAndDump(const Ptr<REagerGraphicsDevice>& device, int number, SnapshotType type, ScreenParameters newParameters);
+  void rescaleAndDumpIfNecessary(DeviceInfo& deviceInfo, int number, ScreenParameters newParameters);
+  void dumpNormal(DeviceInfo &deviceInfo, int number);
   void recordAndDumpIfNecessary(DeviceInfo &deviceInfo, int number);
   std::vector<int> commitAllLast(bool withRescale, ScreenParameters newParameters);
   bool commitByNumber(int number, bool withRescale, ScreenParameters newParameters);
+  void rememberFetchedPlot(DeviceInfo& deviceInfo, int number, const Plot& plot);
   Ptr<REagerGraphicsDevice> replayOnProxy(int number, Size size);
+  bool loadStored(const std::string& parentDirectory, int number, ScreenParameters newParameters,
+                  ScopeProtector* protector, SEXP& plot);
+  bool replayStoredAndDump(const std::string& parentDirectory, int number, int version,
+                           ScreenParameters newParameters, SEXP plot);
 
 public:
   MasterDevice(std::string snapshotDirectory, ScreenParameters screenParameters, int deviceNumber, bool inMemory, bool isProxy);
@@ -76,7 +90,14 @@ public:
   bool rescaleAllLast(ScreenParameters newParameters);
   bool rescaleByNumber(int number, ScreenParameters newParameters);
   bool rescaleByPath(const std::string& parentDirectory, int number, int version, ScreenParameters newParameters);
+
+  // Same as `rescaleByPath()` but the plot is replayed in a forked worker (see `RescaleWorkerPool`).
+  // Returns worker's PID or `-1` on failure
+  int launchRescaleByPath(const std::string& parentDirectory, int number, int version, ScreenParameters newParameters);
   std::vector<int> dumpAllLast();
+
+  // Note: the whole plot is returned every time since the protocol has no messages for a diff
+  // against the previously fetched version. Only the repeated fetches of dumped plots are cheap (see `fetchedPlot`)
   Plot fetchPlot(int number);
   void onNewPage();
   void finalize();
@@ -0,0 +1,89 @@
+#include "PixelUtil.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define RWRAPPER_PIXELUTIL_SSE2
+#include <emmintrin.h>
+#endif
+
+#if defined(RWRAPPER_PIXELUTIL_SSE2) && (defined(__GNUC__) || defined(__clang__))
+#define RWRAPPER_PIXELUTIL_AVX2
+#include <immintrin.h>
+#endif
+
+namespace graphics {
+
+namespace {
+
+const auto PIXEL_SIZE = 4;
+
+// Note: pixels are assembled byte by byte since both buffers might be unaligned
+// and the destination is little-endian regardless of the host's byte order
+void convertScalar(const uint8_t* source, uint8_t* destination, int pixelCount) {
+  for (auto i = 0; i < pixelCount; i++) {
+    auto offset = i * PIXEL_SIZE;
+    destination[offset + 0] = source[offset + 2];  // b
+    destination[offset + 1] = source[offset + 1];  // g
+    destination[offset + 2] = source[offset + 0];  // r
+    destination[offset + 3] = source[offset + 3];  // a
+  }
+}
+
+#ifdef RWRAPPER_PIXELUTIL_SSE2
+int convertSse2(const uint8_t* source, uint8_t* destination, int pixelCount) {
+  const auto blockSize = 4;
+  auto alphaGreenMask = _mm_set1_epi32(int(0xff00ff00U));
+  auto lowMask = _mm_set1_epi32(0xff);
+  auto blockCount = pixelCount / blockSize;
+  for (auto i = 0; i < blockCount; i++) {
+    auto offset = i * blockSize * PIXEL_SIZE;
+    auto pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + offset));
+    auto alphaGreen = _mm_and_si128(pixels, alphaGreenMask);
+    auto blue = _mm_and_si128(_mm_srli_epi32(pixels, 16), lowMask);
+    auto red = _mm_slli_epi32(_mm_and_si128(pixels, lowMask), 16);
+    auto result = _mm_or_si128(alphaGreen, _mm_or_si128(blue, red));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(destination + offset), result);
+  }
+  return blockCount * blockSize;
+}
+#endif
+
+#ifdef RWRAPPER_PIXELUTIL_AVX2
+__attribute__((target("avx2")))
+int convertAvx2(const uint8_t* source, uint8_t* destination, int pixelCount) {
+  const auto blockSize = 8;
+  auto shuffle = _mm256_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15,
+                                  2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+  auto blockCount = pixelCount / blockSize;
+  for (auto i = 0; i < blockCount; i++) {
+    auto offset = i * blockSize * PIXEL_SIZE;
+    auto pixels = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(source + offset));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(destination + offset), _mm256_shuffle_epi8(pixels, shuffle));
+  }
+  return blockCount * blockSize;
+}
+
+bool isAvx2Supported() {
+  static auto isSupported = bool(__builtin_cpu_supports("avx2"));
+  return isSupported;
+}
+#endif
+
+}  // anonymous
+
+void PixelUtil::convertAbgrToArgb(const uint8_t* source, uint8_t* destination, int pixelCount) {
+  auto converted = 0;
+#ifdef RWRAPPER_PIXELUTIL_AVX2
+  if (isAvx2Supported()) {
+    converted = convertAvx2(source, destination, pixelCount);
+  }
+#endif
+#ifdef RWRAPPER_PIXELUTIL_SSE2
+  if (converted == 0) {
+    converted = convertSse2(source, destination, pixelCount);
+  }
+#endif
+  auto offset = converted * PIXEL_SIZE;
+  convertScalar(source + offset, destination + offset, pixelCount - converted);
+}
+
+}  // graphics
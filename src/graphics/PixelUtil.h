@@ -0,0 +1,22 @@
+#ifndef RWRAPPER_PIXELUTIL_H
+#define RWRAPPER_PIXELUTIL_H
+
+#include <cstdint>
+
+namespace graphics {
+
+class PixelUtil {
+public:
+  PixelUtil() = delete;
+
+  /**
+   * Convert R's native `uint32[]` of ABGR (i.e. red is in the lowest byte)
+   * into a little-endian `uint32[]` of ARGB which is expected by a client side.
+   * Note: `source` and `destination` may be unaligned but must not overlap
+   */
+  static void convertAbgrToArgb(const uint8_t* source, uint8_t* destination, int pixelCount);
+};
+
+}  // graphics
+
+#endif //RWRAPPER_PIXELUTIL_H
@@ -1,11 +1,15 @@
 #include "PlotUtil.h"
 
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
 #include <limits>
 #include <iostream>
 #include <unordered_map>
 
 #include "FontUtil.h"
 #include "AffinePoint.h"
+#include "StyleRegistry.h"
 
 #include "actions/CircleAction.h"
 #include "actions/ClipAction.h"
@@ -37,8 +41,14 @@ namespace {
 const auto STROKE_WIDTH_THRESHOLD = 1.0 / 72.0;  // 1 px (in inches)
 const auto LINE_DISTANCE_THRESHOLD = 2.0 / 72.0;  // 2 px (in inches)
 const auto POLYLINE_LENGTH_THRESHOLD = 7;  // Note: prevent optimizing hexagons
-const auto MAX_CIRCLES_PER_CELL = 250;
 const auto CIRCLE_DISTANCE_THRESHOLD = 12.0 / 72.0;  // 12 px (in inches)
+const auto DENSITY_AGGREGATION_THRESHOLD = 10000;  // Note: don't aggregate ordinary scatter plots
+const auto MIN_DENSITY_ALPHA = 0x40;
+const auto LOD_LENGTH_THRESHOLD = 4096;  // Note: ordinary polylines are left intact
+const auto LOD_DISTANCE_THRESHOLD = 0.5 / 72.0;  // 0.5 px (in inches)
+const auto LOD_MIN_SIDE = 1.0;  // inches
+const auto LOD_MAX_SIDE = 40.0;  // inches (about a 4K screen at 96 DPI)
+const auto LOD_MAX_VISITS_PER_POINT = 32;  // Note: a balanced simplification needs about log2(n) visits
 
 struct Intersection {
   bool isExistent;
@@ -167,15 +177,195 @@ std::pair<double, double> extrapolateFixed(Size firstSize, Size secondSize) {
   return std::make_pair(ratio, delta);
 }
 
-int getGridIndex(double value, double side, int gridSide) {
-  auto index = int((value / side) * gridSide);
-  return std::min(std::max(0, index), gridSide - 1);
+std::int64_t getCellKey(std::int64_t x, std::int64_t y) {
+  return std::int64_t((std::uint64_t(x) << 32U) | (std::uint64_t(y) & 0xffffffffULL));
 }
 
-std::pair<int, int> getGridIndices(Point point, const Rectangle& area, int gridSide) {
-  auto x = getGridIndex(point.x - area.from.x, area.width(), gridSide);
-  auto y = getGridIndex(point.y - area.from.y, area.height(), gridSide);
-  return std::make_pair(x, y);
+std::int64_t getCellKey(Point point, double cellSide) {
+  auto x = std::int64_t(std::floor(point.x / cellSide));
+  auto y = std::int64_t(std::floor(point.y / cellSide));
+  return getCellKey(x, y);
+}
+
+bool isFixedRatio(const Rectangle& internal, const Rectangle& external) {
+  if (isClose(internal.from.x, external.from.x) && isClose(internal.to.x, external.to.x)) {
+    // Note: make sure the viewport is centered vertically
+    auto topGap = internal.from.y - external.from.y;
+    auto bottomGap = external.to.y - internal.to.y;
+    return isClose(topGap, bottomGap) && topGap > 0;
+  } else if (isClose(internal.from.y, external.from.y) && isClose(internal.to.y, external.to.y)) {
+    // Note: make sure the viewport is centered horizontally
+    auto leftGap = internal.from.x - external.from.x;
+    auto rightGap = external.to.x - internal.to.x;
+    return isClose(leftGap, rightGap) && leftGap > 0;
+  } else {
+    return false;
+  }
+}
+
+bool isNested(const Rectangle& internal, const Rectangle& external) {
+  if (internal.from.x < external.from.x - EPSILON) {
+    return false;
+  }
+  if (internal.to.x > external.to.x + EPSILON) {
+    return false;
+  }
+  if (internal.from.y < external.from.y - EPSILON) {
+    return false;
+  }
+  return internal.to.y < external.to.y + EPSILON;
+}
+
+double evaluate(AffineCoordinate coordinate, double side) {
+  return coordinate.scale * side + coordinate.offset;
+}
+
+/**
+ * Check whether a point can be replaced with a point of a segment without a visible error.
+ * The deviation `point - lerp(from, to, t)` is linear in viewport's sides for a fixed `t`,
+ * so if it's small enough for both the smallest and the largest sides,
+ * it's small enough for any viewport's size in between
+ */
+bool isCloseToSegment(const AffinePoint& point, const AffinePoint& from, const AffinePoint& to) {
+  auto fromX = evaluate(from.x, LOD_MAX_SIDE);
+  auto fromY = evaluate(from.y, LOD_MAX_SIDE);
+  auto dx = evaluate(to.x, LOD_MAX_SIDE) - fromX;
+  auto dy = evaluate(to.y, LOD_MAX_SIDE) - fromY;
+  auto lengthSquared = dx * dx + dy * dy;
+  auto t = 0.0;
+  if (lengthSquared > 0.0) {
+    auto projection = (evaluate(point.x, LOD_MAX_SIDE) - fromX) * dx + (evaluate(point.y, LOD_MAX_SIDE) - fromY) * dy;
+    t = std::min(std::max(projection / lengthSquared, 0.0), 1.0);
+  }
+  auto maxDeviation = LOD_DISTANCE_THRESHOLD / std::sqrt(2.0);  // Note: per axis
+  for (auto side : {LOD_MIN_SIDE, LOD_MAX_SIDE}) {
+    auto deviationX = evaluate(point.x, side) - ((1.0 - t) * evaluate(from.x, side) + t * evaluate(to.x, side));
+    auto deviationY = evaluate(point.y, side) - ((1.0 - t) * evaluate(from.y, side) + t * evaluate(to.y, side));
+    if (std::abs(deviationX) > maxDeviation || std::abs(deviationY) > maxDeviation) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool isMonotonicByX(const std::vector<AffinePoint>& points) {
+  for (auto side : {LOD_MIN_SIDE, LOD_MAX_SIDE}) {
+    auto isNonDecreasing = true;
+    auto isNonIncreasing = true;
+    for (auto i = 1U; i < points.size(); i++) {
+      auto delta = evaluate(points[i].x, side) - evaluate(points[i - 1].x, side);
+      isNonDecreasing = isNonDecreasing && delta >= 0.0;
+      isNonIncreasing = isNonIncreasing && delta <= 0.0;
+    }
+    if (!isNonDecreasing && !isNonIncreasing) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/**
+ * Min/max decimation for series which are monotonic by X (say, time series).
+ * Points are split into columns which are narrower than the LOD threshold even for the largest viewport.
+ * Only the first, the last, the lowest and the highest points of each column are kept
+ * so the vertical extent drawn for every column doesn't change.
+ * **Note:** points of a series share a viewport, so their vertical order doesn't depend on its size
+ */
+void buildMinMaxMask(const std::vector<AffinePoint>& points, std::vector<bool>& isKept) {
+  auto pointCount = int(points.size());
+  auto columnStart = 0;
+  while (columnStart < pointCount) {
+    auto columnX = evaluate(points[columnStart].x, LOD_MAX_SIDE);
+    auto lowestIndex = columnStart;
+    auto highestIndex = columnStart;
+    auto columnEnd = columnStart + 1;
+    while (columnEnd < pointCount && std::abs(evaluate(points[columnEnd].x, LOD_MAX_SIDE) - columnX) < LOD_DISTANCE_THRESHOLD) {
+      auto y = evaluate(points[columnEnd].y, LOD_MAX_SIDE);
+      if (y < evaluate(points[lowestIndex].y, LOD_MAX_SIDE)) {
+        lowestIndex = columnEnd;
+      }
+      if (y > evaluate(points[highestIndex].y, LOD_MAX_SIDE)) {
+        highestIndex = columnEnd;
+      }
+      columnEnd++;
+    }
+    isKept[columnStart] = true;
+    isKept[lowestIndex] = true;
+    isKept[highestIndex] = true;
+    isKept[columnEnd - 1] = true;
+    columnStart = columnEnd;
+  }
+}
+
+/**
+ * An implementation of the Ramer-Douglas-Peucker algorithm for the full-resolution points
+ * (see `isCloseToSegment()` for the error bound).
+ * Its worst case is quadratic (say, for a spiral), so the number of visited points is bounded.
+ * Once the budget is exhausted, all points of the remaining ranges are kept as is
+ * which is always exact but just doesn't reduce them.
+ * **Note:** it's iterative since huge polylines would overflow the stack otherwise
+ */
+void buildSimplificationMask(const std::vector<AffinePoint>& points, std::vector<bool>& isKept) {
+  auto pointCount = int(points.size());
+  isKept[0] = true;
+  isKept[pointCount - 1] = true;
+  auto visitBudget = int64_t(pointCount) * LOD_MAX_VISITS_PER_POINT;
+  auto ranges = std::vector<std::pair<int, int>>{{0, pointCount - 1}};
+  while (!ranges.empty()) {
+    auto range = ranges.back();
+    ranges.pop_back();
+    visitBudget -= range.second - range.first;
+    if (visitBudget < 0) {
+      std::fill(isKept.begin() + range.first, isKept.begin() + range.second, true);
+      continue;
+    }
+    auto farthestIndex = -1;
+    auto maxDistance = 0.0;
+    auto line = Line(Point{evaluate(points[range.first].x, LOD_MAX_SIDE), evaluate(points[range.first].y, LOD_MAX_SIDE)},
+                     Point{evaluate(points[range.second].x, LOD_MAX_SIDE), evaluate(points[range.second].y, LOD_MAX_SIDE)});
+    auto isSegmentSufficient = true;
+    for (auto index = range.first + 1; index < range.second; index++) {
+      const auto& point = points[index];
+      auto distance = line.distanceTo(Point{evaluate(point.x, LOD_MAX_SIDE), evaluate(point.y, LOD_MAX_SIDE)});
+      if (distance > maxDistance) {
+        maxDistance = distance;
+        farthestIndex = index;
+      }
+      if (isSegmentSufficient && !isCloseToSegment(point, points[range.first], points[range.second])) {
+        isSegmentSufficient = false;
+      }
+    }
+    if (!isSegmentSufficient) {
+      if (farthestIndex == -1) {
+        farthestIndex = (range.first + range.second) / 2;  // Note: the points are collinear for the largest viewport only
+      }
+      isKept[farthestIndex] = true;
+      ranges.emplace_back(range.first, farthestIndex);
+      ranges.emplace_back(farthestIndex, range.second);
+    }
+  }
+}
+
+/**
+ * Drop points of huge polylines which don't make a visible difference for any viewport's size
+ * up to `LOD_MAX_SIDE`. Returns `false` if nothing can be dropped
+ */
+bool buildLevelOfDetailMask(const std::vector<AffinePoint>& points, std::vector<bool>& isKept) {
+  if (int(points.size()) <= LOD_LENGTH_THRESHOLD) {
+    return false;
+  }
+  isKept.assign(points.size(), false);
+  if (isMonotonicByX(points)) {
+    buildMinMaxMask(points, isKept);
+  } else {
+    buildSimplificationMask(points, isKept);
+  }
+  for (auto kept : isKept) {
+    if (!kept) {
+      return true;
+    }
+  }
+  return false;
 }
 
 class DifferentialParser {
@@ -191,14 +381,13 @@ private:
   const std::vector<Ptr<Action>>& firstActions;
   const std::vector<Ptr<Action>>& secondActions;
   int totalComplexity;
+  bool isDensityAggregationEnabled;
 
-  std::unordered_map<int, int> color2Indices;  // The key is a `Color::value`
+  Ptr<StyleRegistry> styles;
   std::vector<Rectangle> secondClippingAreas;
   std::vector<Rectangle> firstClippingAreas;
   std::vector<Ptr<Viewport>> viewports;
-  std::vector<Stroke> strokes;
   std::vector<Layer> layers;
-  std::vector<Font> fonts;
 
   const LineAction* currentLineAction = nullptr;
   std::vector<const LineAction*> lineActions;
@@ -269,6 +458,9 @@ private:
     } else {
       auto mask = buildPreviewMask(firstCircles);
       auto circleCount = int(firstCircles.size());
+      if (isDensityAggregationEnabled && circleCount >= DENSITY_AGGREGATION_THRESHOLD) {
+        return aggregateDensity(firstCircles, secondCircles, mask);
+      }
       for (auto i = 0; i < circleCount - 1; i++) {
         currentFigures.push_back(extrapolateCircle(firstCircles[i], secondCircles[i], mask[i]));
       }
@@ -276,42 +468,108 @@ private:
     }
   }
 
-  std::vector<bool> buildPreviewMask(const std::vector<const CircleAction*>& circles) {
+  static std::vector<bool> buildPreviewMask(const std::vector<const CircleAction*>& circles) {
+    // Note: a circle can be removed from a preview if there is a visible circle drawn after it
+    // within `CIRCLE_DISTANCE_THRESHOLD`. Visible circles are stored in a uniform hash grid
+    // with the cell side equal to the threshold, so only 3x3 neighbour cells are to be checked.
+    // Visible circles are at least the threshold apart, hence each cell contains O(1) of them
     auto circleCount = int(circles.size());
-    auto cellCount = circleCount / MAX_CIRCLES_PER_CELL;
-    auto gridSide = int(std::sqrt(cellCount));
     auto mask = std::vector<bool>(circleCount, false);  // `true` means that a circle can be removed from a preview
-    if (gridSide > 1) {
-      const auto& clippingArea = firstClippingAreas[currentClippingAreaIndex];
-      auto cells = std::vector<std::vector<int>>(gridSide * gridSide);
-      for (auto i = 0; i < circleCount; i++) {
-        auto pair = getGridIndices(circles[i]->getCenter(), clippingArea, gridSide);
-        cells[pair.second * gridSide + pair.first].push_back(i);
-      }
-      for (const auto& cell : cells) {
-        buildPreviewMask(mask, circles, &cell);
+    auto cells = std::unordered_map<std::int64_t, std::vector<int>>();
+    for (auto i = circleCount - 1; i >= 0; i--) {
+      auto center = circles[i]->getCenter();
+      auto x = std::int64_t(std::floor(center.x / CIRCLE_DISTANCE_THRESHOLD));
+      auto y = std::int64_t(std::floor(center.y / CIRCLE_DISTANCE_THRESHOLD));
+      mask[i] = hasVisibleRival(circles, cells, center, x, y);
+      if (!mask[i]) {
+        cells[getCellKey(x, y)].push_back(i);
       }
-    } else {
-      buildPreviewMask(mask, circles, /* indices */ nullptr);
     }
     return mask;
   }
 
-  static void buildPreviewMask(std::vector<bool>& mask, const std::vector<const CircleAction*>& circles, const std::vector<int>* indices) {
-    auto indexCount = indices != nullptr ? int(indices->size()) : int(circles.size());
-    for (auto i = indexCount - 2; i >= 0; i--) {
-      auto circleIndex = indices != nullptr ? (*indices)[i] : i;
-      for (auto j = i + 1; j < indexCount; j++) {
-        auto rivalIndex = indices != nullptr ? (*indices)[j] : j;
-        if (mask[rivalIndex]) {
-          continue;  // rival is not visible, don't compare to it
+  static bool hasVisibleRival(const std::vector<const CircleAction*>& circles,
+                              const std::unordered_map<std::int64_t, std::vector<int>>& cells,
+                              Point center, std::int64_t x, std::int64_t y)
+  {
+    for (auto dx = -1; dx <= 1; dx++) {
+      for (auto dy = -1; dy <= 1; dy++) {
+        auto it = cells.find(getCellKey(x + dx, y + dy));
+        if (it == cells.end()) {
+          continue;
         }
-        if (distance(circles[rivalIndex]->getCenter(), circles[circleIndex]->getCenter()) < CIRCLE_DISTANCE_THRESHOLD) {
-          mask[circleIndex] = true;  // circle is not visible due to rival
-          break;
+        for (auto rivalIndex : it->second) {
+          if (distance(circles[rivalIndex]->getCenter(), center) < CIRCLE_DISTANCE_THRESHOLD) {
+            return true;
+          }
         }
       }
     }
+    return false;
+  }
+
+  /**
+   * Replace circles which are masked in a preview with a density layer:
+   * masked circles are binned into square cells of `CIRCLE_DISTANCE_THRESHOLD` side
+   * and each cell is painted with the color of its circles and opacity proportional to their count
+   */
+  Ptr<Figure> aggregateDensity(const std::vector<const CircleAction*>& firstCircles,
+                               const std::vector<const CircleAction*>& secondCircles,
+                               const std::vector<bool>& mask)
+  {
+    struct Cell {
+      int count;
+      Color color;
+    };
+    auto cells = std::unordered_map<std::int64_t, Cell>();
+    auto cellOrder = std::vector<std::int64_t>();
+    auto maxCount = 0;
+    auto circleCount = int(firstCircles.size());
+    auto densityIndex = -1;  // Note: the density layer takes the place of the first masked circle in order to keep z-order
+    for (auto i = 0; i < circleCount; i++) {
+      if (!mask[i]) {
+        currentFigures.push_back(extrapolateCircle(firstCircles[i], secondCircles[i], /* isMasked */ false));
+        continue;
+      }
+      if (densityIndex < 0) {
+        densityIndex = int(currentFigures.size());
+      }
+      auto key = getCellKey(firstCircles[i]->getCenter(), CIRCLE_DISTANCE_THRESHOLD);
+      auto it = cells.find(key);
+      if (it == cells.end()) {
+        auto fill = firstCircles[i]->getFill();
+        it = cells.emplace(key, Cell{0, fill.isTransparent() ? firstCircles[i]->getColor() : fill}).first;
+        cellOrder.push_back(key);
+      }
+      maxCount = std::max(maxCount, ++it->second.count);
+    }
+    const auto& firstArea = firstClippingAreas[currentViewportIndex];
+    const auto& secondArea = secondClippingAreas[currentViewportIndex];
+    auto toSecond = [&](Point point) {
+      auto x = secondArea.from.x + (point.x - firstArea.from.x) / firstArea.width() * secondArea.width();
+      auto y = secondArea.from.y + (point.y - firstArea.from.y) / firstArea.height() * secondArea.height();
+      return Point{x, y};
+    };
+    auto densityFigures = std::vector<Ptr<Figure>>();
+    for (auto key : cellOrder) {
+      const auto& cell = cells.at(key);
+      auto x = double(key >> 32);
+      auto y = double(std::int32_t(key & 0xffffffffLL));
+      auto from = Point{x, y} * CIRCLE_DISTANCE_THRESHOLD;
+      auto to = Point{x + 1.0, y + 1.0} * CIRCLE_DISTANCE_THRESHOLD;
+      auto alpha = MIN_DENSITY_ALPHA + (0xff - MIN_DENSITY_ALPHA) * cell.count / maxCount;
+      auto color = Color(int((unsigned(cell.color.value) & 0x00ffffffU) | (unsigned(alpha) << 24U)));
+      auto fillIndex = getOrRegisterColorIndex(color);
+      densityFigures.push_back(makePtr<RectangleFigure>(extrapolate(from, toSecond(from)), extrapolate(to, toSecond(to)),
+                                                        -1, -1, fillIndex));
+    }
+    if (densityIndex >= 0) {
+      currentFigures.insert(currentFigures.begin() + densityIndex, densityFigures.begin(), densityFigures.end());
+    }
+    // Note: the last circle is never masked since there are no circles drawn after it
+    auto last = currentFigures.back();
+    currentFigures.pop_back();
+    return last;
   }
 
   Ptr<CircleFigure> extrapolateCircle(const CircleAction* firstCircle, const CircleAction* secondCircle, bool isMasked) {
@@ -507,7 +765,7 @@ private:
     return graphics::extrapolate(firstArea.height(), firstRadius, secondArea.height(), secondRadius);
   }
 
-  Polyline extrapolate(const std::vector<Point>& firstPoints, const std::vector<Point>& secondPoints) {
+  Polyline extrapolate(const ArenaVector<Point>& firstPoints, const ArenaVector<Point>& secondPoints) {
     if (firstPoints.size() != secondPoints.size()) {
       throw ParsingError(PlotError::MISMATCHING_ACTIONS);
     }
@@ -517,13 +775,25 @@ private:
     for (auto i = 0; i < pointCount; i++) {
       points.push_back(extrapolate(firstPoints[i], secondPoints[i]));
     }
-    auto preview = buildPreviewMask(firstPoints);
+    auto isKept = std::vector<bool>();
+    if (buildLevelOfDetailMask(points, isKept)) {
+      auto keptPoints = std::vector<AffinePoint>();
+      auto keptFirstPoints = std::vector<Point>();
+      for (auto i = 0; i < pointCount; i++) {
+        if (isKept[i]) {
+          keptPoints.push_back(points[i]);
+          keptFirstPoints.push_back(firstPoints[i]);
+        }
+      }
+      auto preview = buildPreviewMask(keptFirstPoints.data(), int(keptFirstPoints.size()));
+      return Polyline{std::move(keptPoints), std::move(preview.first), preview.second};
+    }
+    auto preview = buildPreviewMask(firstPoints.data(), pointCount);
     return Polyline{std::move(points), std::move(preview.first), preview.second};
   }
 
-  static std::pair<std::vector<bool>, int> buildPreviewMask(const std::vector<Point>& points) {
-    auto mask = std::vector<bool>(points.size(), false);  // `true` means that a point [i] might be skipped in a preview
-    auto pointCount = int(points.size());
+  static std::pair<std::vector<bool>, int> buildPreviewMask(const Point* points, int pointCount) {
+    auto mask = std::vector<bool>(pointCount, false);  // `true` means that a point [i] might be skipped in a preview
     if (pointCount > POLYLINE_LENGTH_THRESHOLD) {
       auto previewCount = buildPreviewMask(mask, points, 0, pointCount);
       return std::make_pair(std::move(mask), previewCount);
@@ -532,7 +802,7 @@ private:
     }
   }
 
-  static int buildPreviewMask(std::vector<bool>& mask, const std::vector<Point>& points, int startIndex, /* exclusive */ int endIndex) {
+  static int buildPreviewMask(std::vector<bool>& mask, const Point* points, int startIndex, /* exclusive */ int endIndex) {
     // Note: an implementation of the Ramer-Douglas-Peucker algorithm
     if (endIndex - startIndex <= 2) {
       return endIndex - startIndex;  // all points are visible
@@ -578,35 +848,6 @@ private:
     }
   }
 
-  static bool isFixedRatio(const Rectangle& internal, const Rectangle& external) {
-    if (isClose(internal.from.x, external.from.x) && isClose(internal.to.x, external.to.x)) {
-      // Note: make sure the viewport is centered vertically
-      auto topGap = internal.from.y - external.from.y;
-      auto bottomGap = external.to.y - internal.to.y;
-      return isClose(topGap, bottomGap) && topGap > 0;
-    } else if (isClose(internal.from.y, external.from.y) && isClose(internal.to.y, external.to.y)) {
-      // Note: make sure the viewport is centered horizontally
-      auto leftGap = internal.from.x - external.from.x;
-      auto rightGap = external.to.x - internal.to.x;
-      return isClose(leftGap, rightGap) && leftGap > 0;
-    } else {
-      return false;
-    }
-  }
-
-  static bool isNested(const Rectangle& internal, const Rectangle& external) {
-    if (internal.from.x < external.from.x - EPSILON) {
-      return false;
-    }
-    if (internal.to.x > external.to.x + EPSILON) {
-      return false;
-    }
-    if (internal.from.y < external.from.y - EPSILON) {
-      return false;
-    }
-    return internal.to.y < external.to.y + EPSILON;
-  }
-
   void flushAndSwitchTo(State newState) {
     flushCurrentLayer();
     state = newState;
@@ -694,25 +935,15 @@ private:
   }
 
   int getOrRegisterColorIndex(Color color) {
-    if (color.isTransparent()) {
-      return -1;
-    }
-    auto it = color2Indices.find(color.value);
-    if (it == color2Indices.end()) {
-      auto index = int(color2Indices.size());
-      color2Indices[color.value] = index;
-      return index;
-    } else {
-      return it->second;
-    }
+    return styles->getOrRegisterColorIndex(color);
   }
 
   int getOrRegisterFontIndex(const Font& font) {
-    return getOrRegisterObjectIndex(font, fonts);
+    return styles->getOrRegisterFontIndex(font);
   }
 
   int getOrRegisterStrokeIndex(const Stroke& stroke) {
-    return getOrRegisterObjectIndex(stroke, strokes);
+    return styles->getOrRegisterStrokeIndex(stroke);
   }
 
   template<typename TObject>
@@ -832,7 +1063,7 @@ private:
 
   int getComplexityMultiplier(int strokeIndex, int colorIndex, int fillIndex) const {
     auto hasFill = fillIndex >= 0;
-    auto hasStroke = strokeIndex >= 0 && colorIndex >= 0 && (!hasFill || strokes[strokeIndex].width > STROKE_WIDTH_THRESHOLD);
+    auto hasStroke = strokeIndex >= 0 && colorIndex >= 0 && (!hasFill || styles->getStrokes()[strokeIndex].width > STROKE_WIDTH_THRESHOLD);
     return int(hasFill) + int(hasStroke);
   }
 
@@ -850,17 +1081,15 @@ private:
 public:
   DifferentialParser(Size firstSize, const std::vector<Ptr<Action>>& firstActions,
                      Size secondSize, const std::vector<Ptr<Action>>& secondActions,
-                     int totalComplexity)
+                     int totalComplexity, Ptr<StyleRegistry> styles = nullptr, bool isDensityAggregationEnabled = false)
     : firstSize(firstSize), firstActions(firstActions),
       secondSize(secondSize), secondActions(secondActions),
-      totalComplexity(totalComplexity)
+      totalComplexity(totalComplexity), isDensityAggregationEnabled(isDensityAggregationEnabled),
+      styles(styles ? std::move(styles) : makePtr<StyleRegistry>())
   {
     secondClippingAreas.push_back(Rectangle::make(Point{0.0, 0.0}, secondSize.toPoint()));
     firstClippingAreas.push_back(Rectangle::make(Point{0.0, 0.0}, firstSize.toPoint()));
     viewports.push_back(FreeViewport::createFullScreen());
-    getOrRegisterColorIndex(Color::getBlack());
-    getOrRegisterColorIndex(Color::getWhite());
-    getOrRegisterFontIndex(Font::getDefault());
   }
 
   void parse() {
@@ -884,15 +1113,13 @@ public:
   };
 
   Plot buildPlot(PlotError error = PlotError::NONE) {
-    auto colors = std::vector<Color>(color2Indices.size(), Color(0x00));
-    for (auto pair : color2Indices) {
-      colors[pair.second] = Color(pair.first);
-    }
+    // Note: the registry might be shared with the next versions of this plot, so it is copied, not moved
+    auto fonts = styles->getFonts();
     for (auto& font : fonts) {
       font.name = FontUtil::matchName(font.name);
     }
     auto previewComplexity = calculatePreviewComplexity();
-    return Plot{std::move(fonts), std::move(colors), std::move(strokes), std::move(viewports), std::move(layers),
+    return Plot{std::move(fonts), styles->getColors(), styles->getStrokes(), std::move(viewports), std::move(layers),
                 previewComplexity, totalComplexity, error};
   };
 };
@@ -910,10 +1137,11 @@ Plot PlotUtil::createPlotWithError(PlotError error) {
 
 Plot PlotUtil::extrapolate(Size firstSize, const std::vector<Ptr<Action>>& firstActions,
                            Size secondSize, const std::vector<Ptr<Action>>& secondActions,
-                           int totalComplexity)
+                           int totalComplexity, Ptr<StyleRegistry> styles, bool isDensityAggregationEnabled)
 {
   try {
-    auto parser = DifferentialParser(firstSize, firstActions, secondSize, secondActions, totalComplexity);
+    auto parser = DifferentialParser(firstSize, firstActions, secondSize, secondActions, totalComplexity,
+                                     std::move(styles), isDensityAggregationEnabled);
     parser.parse();
     return parser.buildPlot();
   } catch (const ParsingError& e) {
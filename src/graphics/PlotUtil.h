@@ -6,6 +6,7 @@
 #include "Ptr.h"
 #include "Plot.h"
 #include "ScreenParameters.h"
+#include "StyleRegistry.h"
 #include "actions/Action.h"
 
 namespace graphics {
@@ -15,9 +16,16 @@ public:
   PlotUtil() = delete;
 
   static Plot createPlotWithError(PlotError error);
+
+  /**
+   * Note: pass the same `styles` for all the versions of a plot in order to keep
+   * its font, stroke and color indices stable. If it's `nullptr`, a fresh registry is used
+   */
   static Plot extrapolate(/* inches */ Size firstSize, const std::vector<Ptr<Action>>& firstActions,
                           /* inches */ Size secondSize, const std::vector<Ptr<Action>>& secondActions,
-                          int totalComplexity);
+                          int totalComplexity, Ptr<StyleRegistry> styles = nullptr,
+                          bool isDensityAggregationEnabled = false);
+
 };
 
 }  // graphics
@@ -18,10 +18,12 @@
 #include "REagerGraphicsDevice.h"
 
 #include <cstdio>
+#include <cstring>
 #include <sstream>
 
 #include "Common.h"
 #include "Evaluator.h"
+#include "FontMetricCache.h"
 #include "InitHelper.h"
 #include "SnapshotUtil.h"
 
@@ -97,8 +99,9 @@ REagerGraphicsDevice::REagerGraphicsDevice(std::string snapshotDirectory, int de
     : snapshotDirectory(std::move(snapshotDirectory)), deviceNumber(deviceNumber), snapshotNumber(snapshotNumber),
       snapshotVersion(snapshotVersion), parameters(parameters), slaveDevice(nullptr), isDeviceBlank(true),
       snapshotType(SnapshotType::NORMAL), hasDumped(false), isProxy(isProxy), isPlotOnNewPage(false),
-      clippingArea({-1.0, -1.0, -1.0, -1.0}), inMemory(inMemory)
+      clippingArea({-1.0, -1.0, -1.0, -1.0}), inMemory(inMemory), actionArena(makePtr<Arena>())
 {
+  isRecording = isProxy;  // Note: only the proxy device needs actions (see `MasterDevice::fetchPlot()`)
   getSlave();
 }
 
@@ -155,10 +158,9 @@ void REagerGraphicsDevice::drawCircle(Point center, double radius, pGEcontext co
   if (!inMemory && slave != nullptr) {
     slave->circle(center.x, center.y, radius, context, slave);
   }
-  if (isProxy) {
+  if (account(getComplexityMultiplier(context), "circle")) {
     record<CircleAction>(normalize(center), normalize(radius), extractStroke(context), Color(context->col), Color(context->fill));
   }
-  complexity += getComplexityMultiplier(context);
 }
 
 void REagerGraphicsDevice::clip(Point from, Point to) {
@@ -166,7 +168,7 @@ void REagerGraphicsDevice::clip(Point from, Point to) {
   if (!inMemory && slave != nullptr) {
     slave->clip(from.x, to.x, from.y, to.y, slave);
   }
-  if (isProxy) {
+  if (isRecording && !isOverBudget) {
     auto newArea = normalize(Rectangle::make(from, to));
     if (!isClose(clippingArea, newArea)) {
       record<ClipAction>(newArea);
@@ -185,17 +187,22 @@ void REagerGraphicsDevice::drawLine(Point from, Point to, pGEcontext context) {
   if (!inMemory && slave != nullptr) {
     slave->line(from.x, from.y, to.x, to.y, context, slave);
   }
-  if (isProxy) {
+  if (account(2, "line")) {
     record<LineAction>(normalize(from), normalize(to), extractStroke(context), Color(context->col));
   }
-  complexity += 2;
 }
 
 MetricInfo REagerGraphicsDevice::metricInfo(int character, pGEcontext context) {
   auto metricInfo = MetricInfo{};
+  // Note: a lookup in the cache doesn't require a slave device to be created
+  auto cache = FontMetricCache::getInstance();
+  if (cache->findMetricInfo(context, parameters.resolution, character, metricInfo)) {
+    return metricInfo;
+  }
   auto slave = getSlave();
   if (slave != nullptr) {
     slave->metricInfo(character, context, &metricInfo.ascent, &metricInfo.descent, &metricInfo.width, slave);
+    cache->putMetricInfo(context, parameters.resolution, character, metricInfo);
   }
   return metricInfo;
 }
@@ -214,7 +221,7 @@ void REagerGraphicsDevice::newPage(pGEcontext context) {
   if (!inMemory && slave != nullptr) {
     slave->newPage(context, slave);
   }
-  if (isProxy) {
+  if (isRecording && !isOverBudget) {
     record<NewPageAction>(Color(context->fill));
   }
 }
@@ -225,10 +232,9 @@ void REagerGraphicsDevice::drawPolygon(int n, double *x, double *y, pGEcontext c
   if (!inMemory && slave != nullptr) {
     slave->polygon(n, x, y, context, slave);
   }
-  if (isProxy) {
+  if (account(n * getComplexityMultiplier(context), "polygon")) {
     record<PolygonAction>(createNormalizedPoints(n, x, y), extractStroke(context), Color(context->col), Color(context->fill));
   }
-  complexity += n * getComplexityMultiplier(context);
 }
 
 void REagerGraphicsDevice::drawPolyline(int n, double *x, double *y, pGEcontext context) {
@@ -237,10 +243,9 @@ void REagerGraphicsDevice::drawPolyline(int n, double *x, double *y, pGEcontext
   if (!inMemory && slave != nullptr) {
     slave->polyline(n, x, y, context, slave);
   }
-  if (isProxy) {
+  if (account(n, "polyline")) {
     record<PolylineAction>(createNormalizedPoints(n, x, y), extractStroke(context), Color(context->col));
   }
-  complexity += n;
 }
 
 void REagerGraphicsDevice::drawRect(Point from, Point to, pGEcontext context) {
@@ -249,10 +254,9 @@ void REagerGraphicsDevice::drawRect(Point from, Point to, pGEcontext context) {
   if (!inMemory && slave != nullptr) {
     slave->rect(from.x, from.y, to.x, to.y, context, slave);
   }
-  if (isProxy) {
+  if (account(2 * getComplexityMultiplier(context), "rectangle")) {
     record<RectangleAction>(normalize(Rectangle::make(from, to)), extractStroke(context), Color(context->col), Color(context->fill));
   }
-  complexity += 2 * getComplexityMultiplier(context);
 }
 
 void REagerGraphicsDevice::drawPath(double *x, double *y, int npoly, int *nper, Rboolean winding, pGEcontext context)
@@ -262,8 +266,12 @@ void REagerGraphicsDevice::drawPath(double *x, double *y, int npoly, int *nper,
   if (!inMemory && slave != nullptr) {
     slave->path(x, y, npoly, nper, winding, context, slave);
   }
-  if (isProxy) {
-    auto subPaths = std::vector<std::vector<Point>>();
+  auto pathComplexity = int64_t(0);
+  for (auto i = 0; i < npoly; i++) {
+    pathComplexity += nper[i];
+  }
+  if (account(pathComplexity * getComplexityMultiplier(context), "path")) {
+    auto subPaths = ArenaVector<ArenaVector<Point>>(ArenaAllocator<ArenaVector<Point>>(actionArena));
     subPaths.reserve(npoly);
     auto pointIndex = 0;
     for (auto polyIndex = 0; polyIndex < npoly; polyIndex++) {
@@ -272,10 +280,6 @@ void REagerGraphicsDevice::drawPath(double *x, double *y, int npoly, int *nper,
     }
     record<PathAction>(std::move(subPaths), winding == TRUE, extractStroke(context), Color(context->col), Color(context->fill));
   }
-  auto multiplier = getComplexityMultiplier(context);
-  for (auto i = 0; i < npoly; i++) {
-    complexity += nper[i] * multiplier;
-  }
 }
 
 void REagerGraphicsDevice::drawRaster(unsigned int *raster,
@@ -294,26 +298,18 @@ void REagerGraphicsDevice::drawRaster(unsigned int *raster,
   if (!inMemory && slave != nullptr) {
     slave->raster(raster, w, h, x, y, width, height, rotation, interpolate, context, slave);
   }
-  if (isProxy) {
-    auto pixels = reinterpret_cast<uint32_t*>(raster);  // ensure it's exactly 4 bytes
+  if (account(int64_t(w) * h / 8, "raster")) {
+    // Note: pixels are kept in R's format. They are converted to ARGB only when a message is created
+    // so the conversion writes straight into the message's buffer (see `PixelUtil`)
+    static_assert(sizeof(*raster) == sizeof(uint32_t), "R's pixels are expected to be exactly 4 bytes");
     auto byteCount = w * h * sizeof(uint32_t);
     auto dataPtr = Ptr<uint8_t>(new uint8_t[byteCount], std::default_delete<uint8_t[]>());
-    auto data = dataPtr.get();
-    // Convert to little-endian uint32[] of ARGB
-    for (auto i = 0; i < w * h; i++) {
-      auto abgr = pixels[i];
-      auto byteIndex = i * sizeof(uint32_t);
-      data[byteIndex + 2U] = abgr & 0xffU;  // r
-      data[byteIndex + 1U] = (abgr >> 8U) & 0xffU;  // g
-      data[byteIndex + 0U] = (abgr >> 16U) & 0xffU;  // b
-      data[byteIndex + 3U] = abgr >> 24U;  // a
-    }
+    memcpy(dataPtr.get(), raster, byteCount);
     auto bottomLeft = Point{x, y};
     auto topRight = bottomLeft + Point{width, height};
     auto rectangle = Rectangle::make(bottomLeft, topRight);
     record<RasterAction>(RasterImage{w, h, dataPtr}, normalize(rectangle), rotation, interpolate == TRUE);
   }
-  complexity += w * h / 8;
 }
 
 Rectangle REagerGraphicsDevice::drawingArea() {
@@ -354,16 +350,31 @@ int64_t REagerGraphicsDevice::estimatedComplexity() {
   return complexity;
 }
 
+bool REagerGraphicsDevice::isOverComplexityBudget() {
+  return isOverBudget;
+}
+
+const char* REagerGraphicsDevice::overComplexityBudgetKind() {
+  return overBudgetKind;
+}
+
 double REagerGraphicsDevice::widthOfStringUtf8(const char* text, pGEcontext context) {
+  auto width = 0.0;
+  auto cache = FontMetricCache::getInstance();
+  if (cache->findStringWidth(context, parameters.resolution, text, width)) {
+    return width;
+  }
   auto slave = getSlave();
   if (slave != nullptr) {
     if (slave->strWidthUTF8 != nullptr) {
-      return slave->strWidthUTF8(text, context, slave);
+      width = slave->strWidthUTF8(text, context, slave);
     } else if (slave->strWidth != nullptr) {
-      return slave->strWidth(text, context, slave);
+      width = slave->strWidth(text, context, slave);
     } else {
       return 0.0;
     }
+    cache->putStringWidth(context, parameters.resolution, text, width);
+    return width;
   } else {
     return 0.0;
   }
@@ -379,10 +390,9 @@ void REagerGraphicsDevice::drawTextUtf8(const char* text, Point at, double rotat
       slave->text(at.x, at.y, text, rotation, heightAdjustment, context, slave);
     }
   }
-  if (isProxy) {
+  if (account(10, "text")) {
     record<TextAction>(text, normalize(at), rotation, heightAdjustment, extractFont(context), Color(context->col));
   }
-  complexity += 10;
 }
 
 bool REagerGraphicsDevice::dump() {
@@ -398,6 +408,7 @@ void REagerGraphicsDevice::rescale(SnapshotType newType, ScreenParameters newPar
   parameters = newParameters;
   snapshotVersion++;
   hasDumped = false;
+  discardActions();
 }
 
 const std::vector<Ptr<Action>>& REagerGraphicsDevice::recordedActions() {
@@ -422,7 +433,29 @@ void REagerGraphicsDevice::replayFromFile(const std::string& parentDirectory, in
   replayWithCommand(command);
 }
 
+bool REagerGraphicsDevice::replayRecorded(SEXP plot) {
+  // Note: a replay draws the whole plot from scratch, so previously recorded actions would be duplicated
+  // and the complexity would be counted twice
+  discardActions();
+  complexity = 0;
+  isOverBudget = false;
+  overBudgetKind = nullptr;
+  auto slave = getSlave();
+  if (slave != nullptr) {
+    InitHelper helper;
+    Rf_selectDevice(Rf_ndevNumber(slave));
+    return Evaluator::evaluateCall(SnapshotUtil::getReplayRecordedFunctionName(), plot);
+  }
+  return false;
+}
+
 void REagerGraphicsDevice::replayWithCommand(const std::string &command) {
+  // Note: a replay draws the whole plot from scratch, so previously recorded actions would be duplicated
+  // and the complexity would be counted twice
+  discardActions();
+  complexity = 0;
+  isOverBudget = false;
+  overBudgetKind = nullptr;
   auto slave = getSlave();
   if (slave != nullptr) {
     InitHelper helper;
@@ -431,8 +464,32 @@ void REagerGraphicsDevice::replayWithCommand(const std::string &command) {
   }
 }
 
-std::vector<Point> REagerGraphicsDevice::createNormalizedPoints(int n, const double* xs, const double* ys) {
-  auto points = std::vector<Point>();
+void REagerGraphicsDevice::discardActions() {
+  actions.clear();
+  actionArena = makePtr<Arena>();  // Note: the previous one will be released along with the last of its actions
+  clippingArea = Rectangle{-1.0, -1.0, -1.0, -1.0};
+}
+
+bool REagerGraphicsDevice::account(int64_t cost, const char* kind) {
+  complexity += cost;
+  if (overBudgetKind == nullptr && complexity > MAX_PLOT_COMPLEXITY) {
+    overBudgetKind = kind;
+  }
+  if (isRecording && !isOverBudget && complexity > MAX_PLOT_COMPLEXITY) {
+    // Note: the plot won't be accepted by `MasterDevice::fetchPlot()` anyway,
+    // so there is no need to keep memory for its actions.
+    // The device keeps counting complexity and drawing via the slave (that is, it switches to raster only mode)
+    isOverBudget = true;
+    actions.clear();
+    actions.shrink_to_fit();
+    actionArena = makePtr<Arena>();
+  }
+  return isRecording && !isOverBudget;
+}
+
+ArenaVector<Point> REagerGraphicsDevice::createNormalizedPoints(int n, const double* xs, const double* ys) {
+  // Note: the points are allocated from the same arena as the action they are going to be recorded into
+  auto points = ArenaVector<Point>(ArenaAllocator<Point>(actionArena));
   points.reserve(n);
   for (auto i = 0; i < n; i++) {
     auto point = Point{xs[i], ys[i]};
@@ -27,6 +27,8 @@
 #include <cstdint>
 
 #include "Ptr.h"
+#include "Arena.h"
+#include "FontMetricCache.h"
 #include "ScreenParameters.h"
 #include "Point.h"
 #include "Rectangle.h"
@@ -36,11 +38,8 @@
 
 namespace graphics {
 
-struct MetricInfo {
-  double ascent;
-  double descent;
-  double width;
-};
+// Note: plots which are more complex than this are not recorded since they can't be passed via gRPC
+const auto MAX_PLOT_COMPLEXITY = int64_t(500000);  // 500k
 
 class REagerGraphicsDevice {
 private:
@@ -49,6 +48,7 @@ private:
   bool hasDumped;
   bool inMemory;
   bool isProxy;
+  bool isRecording;
   int deviceNumber;
   int snapshotNumber;
   int snapshotVersion;
@@ -58,22 +58,31 @@ private:
   ScreenParameters parameters;
   Ptr<SlaveDevice> slaveDevice;
   std::vector<Ptr<Action>> actions;
+  Ptr<Arena> actionArena;  // Note: lives while any of the recorded actions (or their point buffers) is alive
   Rectangle clippingArea;
   int64_t complexity = 0;
+  bool isOverBudget = false;
+  const char* overBudgetKind = nullptr;  // Kind of the primitive which has crossed the complexity budget
 
   Ptr<SlaveDevice> initializeSlaveDevice();
   void shutdownSlaveDevice();
   pDevDesc getSlave();
   void replayWithCommand(const std::string& command);
-  std::vector<Point> createNormalizedPoints(int n, const double* xs, const double* ys);
+  void discardActions();
+
+  // Add the cost of a primitive to complexity. Returns `true` if the primitive should be recorded
+  bool account(int64_t cost, const char* kind);
+  ArenaVector<Point> createNormalizedPoints(int n, const double* xs, const double* ys);
   Rectangle normalize(Rectangle rectangle);
   double normalize(double coordinate);
   Point normalize(Point point);
 
   template<typename TAction, typename ...TArgs>
   void record(TArgs &&...args) {
-    auto action = makePtr<TAction>(std::forward<TArgs>(args)...);
-    actions.push_back(action);
+    // Note: an action and its control block share a single arena allocation.
+    // Since the arena is never freed partially, any action kept by a caller pins the memory of all of them
+    auto action = std::allocate_shared<TAction>(ArenaAllocator<TAction>(actionArena), std::forward<TArgs>(args)...);
+    actions.push_back(std::move(action));
   }
 
 public:
@@ -108,6 +117,8 @@ public:
   int currentVersion();
   int currentResolution();
   int64_t estimatedComplexity();
+  bool isOverComplexityBudget();
+  const char* overComplexityBudgetKind();  // Note: `nullptr` if the budget hasn't been crossed
   double widthOfStringUtf8(const char* text, pGEcontext context);
   void drawTextUtf8(const char* text, Point at, double rotation, double heightAdjustment, pGEcontext context);
   bool dump();
@@ -117,6 +128,7 @@ public:
   bool isBlank();
   void replay();
   void replayFromFile(const std::string& parentDirectory, int number);
+  bool replayRecorded(SEXP plot);
 };
 
 }  // graphics
@@ -0,0 +1,213 @@
+//  Rkernel is an execution kernel for R interpreter
+//  Copyright (C) 2019 JetBrains s.r.o.
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#include "RescaleWorkerPool.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <thread>
+
+#ifndef _WIN32
+#include <pthread.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <Rinternals.h>
+#include <R_ext/eventloop.h>
+
+#include "../RStuff/Exceptions.h"
+#endif
+
+namespace graphics {
+
+namespace {
+
+// Note: each worker is a copy of the whole R process, so their number is limited
+// regardless of the number of cores
+const auto MAX_WORKER_COUNT = 4;
+
+// Note: a rescale of a stored plot usually takes a second at most,
+// so a worker running for that long is most likely stuck
+const auto WORKER_TIMEOUT = std::chrono::seconds(30);
+const auto MAX_POLL_INTERVAL = std::chrono::milliseconds(50);
+
+#ifndef _WIN32
+bool isExited(pid_t pid, bool isBlocking) {
+  // Note: the worker is waited for without being reaped, so its PID cannot be reused
+  // (and killed by a newer request) until `workerPid` is cleared under the lock
+  auto info = siginfo_t();
+  auto options = WEXITED | WNOWAIT | (isBlocking ? 0 : WNOHANG);
+  auto result = 0;
+  do {
+    info.si_pid = 0;
+    result = waitid(P_PID, id_t(pid), &info, options);
+  } while (result == -1 && errno == EINTR);
+  // Note: on other errors there is nothing to wait for
+  return result == -1 || info.si_pid != 0;
+}
+
+struct WorkContext {
+  const std::function<bool()>* work;
+  bool result;
+};
+
+void runWork(void* data) {
+  auto context = static_cast<WorkContext*>(data);
+  try {
+    context->result = (*context->work)();
+  } catch (...) {
+    context->result = false;
+  }
+}
+
+void detachFromParent() {
+  // Note: the inherited crash handlers would report a crash of the whole session
+  // and the inherited interrupt handler would jump back into the parent's REPL
+  for (auto signum : {SIGSEGV, SIGILL, SIGBUS, SIGABRT, SIGFPE}) {
+    signal(signum, SIG_DFL);
+  }
+  for (auto signum : {SIGINT, SIGPIPE, SIGUSR1, SIGUSR2}) {
+    signal(signum, SIG_IGN);
+  }
+  auto mask = sigset_t();
+  sigemptyset(&mask);
+  sigaddset(&mask, SIGINT);
+  sigaddset(&mask, SIGPIPE);
+  pthread_sigmask(SIG_BLOCK, &mask, nullptr);
+  R_interrupts_suspended = TRUE;
+
+  // Note: the event loop pipe and the other input handlers belong to the parent,
+  // so the worker must not consume their events. The first handler is the one for stdin
+  if (R_InputHandlers != nullptr) {
+    R_InputHandlers->next = nullptr;
+  }
+  R_PolledEvents = [] {};
+}
+#endif
+
+}  // anonymous
+
+RescaleWorkerPool::RescaleWorkerPool()
+  : maxWorkerCount(std::max(1, std::min(MAX_WORKER_COUNT, int(std::thread::hardware_concurrency()) / 2))) {}
+
+RescaleWorkerPool* RescaleWorkerPool::getInstance() {
+  static auto instance = new RescaleWorkerPool();
+  return instance;
+}
+
+#ifndef _WIN32
+bool RescaleWorkerPool::isSupported() {
+  return true;
+}
+
+int RescaleWorkerPool::forkWorker(const std::function<bool()>& work) {
+  auto pid = fork();
+  if (pid == 0) {
+    detachFromParent();
+    // Note: an R error must not unwind into the parent's contexts and an exception must not
+    // escape into the parent's frames, so any failure ends up with a non-zero status.
+    // `_exit()` is used in order not to run any atexit handlers or destructors
+    // which belong to the parent process (say, the ones of gRPC server)
+    auto context = WorkContext{&work, false};
+    auto isCompleted = R_ToplevelExec(runWork, &context);
+    _exit(isCompleted && context.result ? 0 : 1);
+  }
+  return pid > 0 ? int(pid) : -1;
+}
+
+RescaleWorkerPool::Result RescaleWorkerPool::run(const std::string& key, const std::function<int()>& launch) {
+  std::unique_lock<std::mutex> lock(mutex);
+  auto& state = key2States[key];
+  auto generation = ++state.latestGeneration;
+  if (state.workerPid > 0) {
+    kill(state.workerPid, SIGKILL);
+  }
+  condition.notify_all();
+
+  // Note: a new worker for the same key must wait until the previous one has exited,
+  // otherwise both of them might write the same file
+  condition.wait(lock, [&] {
+    return state.latestGeneration != generation || (state.workerPid == -1 && workerCount < maxWorkerCount);
+  });
+  if (state.latestGeneration != generation) {
+    return Result::SUPERSEDED;
+  }
+  workerCount++;
+  state.workerPid = 0;
+  lock.unlock();
+
+  auto pid = launch();
+
+  lock.lock();
+  if (pid <= 0) {
+    state.workerPid = -1;
+    workerCount--;
+    condition.notify_all();
+    return Result::FAILED;
+  }
+  state.workerPid = pid;
+  if (state.latestGeneration != generation) {
+    kill(pid, SIGKILL);
+  }
+  lock.unlock();
+
+  auto deadline = std::chrono::steady_clock::now() + WORKER_TIMEOUT;
+  auto interval = std::chrono::milliseconds(1);
+  auto isTimedOut = false;
+  while (!isExited(pid, false)) {
+    if (std::chrono::steady_clock::now() >= deadline) {
+      kill(pid, SIGKILL);
+      isExited(pid, true);
+      isTimedOut = true;
+      break;
+    }
+    std::this_thread::sleep_for(interval);
+    interval = std::min(interval * 2, MAX_POLL_INTERVAL);
+  }
+
+  lock.lock();
+  state.workerPid = -1;
+  auto status = 0;
+  auto result = pid_t();
+  do {
+    result = waitpid(pid, &status, 0);
+  } while (result == -1 && errno == EINTR);
+  workerCount--;
+  condition.notify_all();
+  if (!isTimedOut && result == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0) {
+    return Result::SUCCEEDED;
+  }
+  // Note: a worker killed by a newer request isn't a failure
+  return state.latestGeneration != generation ? Result::SUPERSEDED : Result::FAILED;
+}
+#else
+bool RescaleWorkerPool::isSupported() {
+  return false;
+}
+
+int RescaleWorkerPool::forkWorker(const std::function<bool()>& work) {
+  return -1;
+}
+
+RescaleWorkerPool::Result RescaleWorkerPool::run(const std::string& key, const std::function<int()>& launch) {
+  return Result::FAILED;
+}
+#endif
+
+}  // graphics
@@ -0,0 +1,81 @@
+//  Rkernel is an execution kernel for R interpreter
+//  Copyright (C) 2019 JetBrains s.r.o.
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#ifndef RWRAPPER_RESCALEWORKERPOOL_H
+#define RWRAPPER_RESCALEWORKERPOOL_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace graphics {
+
+/**
+ * Runs rescales of stored plots in forked copies of the R process
+ * so the main R thread is busy only for the duration of `fork()`.
+ * At most a few workers are running simultaneously. Requests for the same plot
+ * are coalesced: a newer request drops the waiting ones and kills the running one
+ * since only the latest size is going to be displayed.
+ * **Note:** a forked copy of a multithreaded process might deadlock on a lock
+ * held by another thread (say, a gRPC one) at the moment of `fork()`,
+ * so a worker which doesn't exit in time is killed and reported as failed.
+ * **Note:** forking is available on Unix-like systems only (see `isSupported()`)
+ */
+class RescaleWorkerPool {
+public:
+  enum class Result {
+    SUCCEEDED,
+    SUPERSEDED,  // A newer request for the same key has been made
+    FAILED,  // The worker couldn't be launched, has failed or has timed out
+  };
+
+private:
+  struct KeyState {
+    int64_t latestGeneration = 0;
+    int workerPid = -1;  // Note: `0` means that a worker is being launched
+  };
+
+  std::mutex mutex;
+  std::condition_variable condition;
+  std::unordered_map<std::string, KeyState> key2States;
+  int workerCount = 0;
+  int maxWorkerCount;
+
+  RescaleWorkerPool();
+
+public:
+  static RescaleWorkerPool* getInstance();
+  static bool isSupported();
+
+  // Must be called from the main R thread. Returns worker's PID or `-1` on failure.
+  // The worker runs `work()` and exits immediately with a status depending on its result
+  static int forkWorker(const std::function<bool()>& work);
+
+  /**
+   * Wait for a free worker slot, call `launch()` (which should use `forkWorker()`)
+   * and wait for the worker to exit. Blocks the calling thread, so it must not be the main R thread.
+   * On `Result::FAILED` the caller is supposed to fall back to the rescale in the main process
+   */
+  Result run(const std::string& key, const std::function<int()>& launch);
+};
+
+}  // graphics
+
+#endif //RWRAPPER_RESCALEWORKERPOOL_H
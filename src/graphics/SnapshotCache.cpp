@@ -0,0 +1,224 @@
+//  Rkernel is an execution kernel for R interpreter
+//  Copyright (C) 2019 JetBrains s.r.o.
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+
+#include "SnapshotCache.h"
+
+#include <cmath>
+#include <fstream>
+
+#include "../util/FileUtil.h"
+
+namespace graphics {
+
+namespace {
+
+const auto MAX_MEMORY_BYTE_COUNT = int64_t(32) << 20U;
+const auto MAX_DISK_BYTE_COUNT = int64_t(256) << 20U;
+
+// Note: besides the current snapshot directories, caches are created for stored plots
+// of previous sessions which are never closed explicitly, so the least recently used ones are dropped
+const auto MAX_INSTANCE_COUNT = 4U;
+
+std::mutex instanceMutex;
+
+using InstanceList = std::list<std::pair<std::string, Ptr<SnapshotCache>>>;
+
+InstanceList& getInstances() {
+  static auto instances = InstanceList();  // Note: the most recently used ones go first
+  return instances;
+}
+
+// Note: there must be no entry for `key` in `tier`
+template<typename TTier, typename TValue>
+void putInto(TTier& tier, const SnapshotKey& key, TValue value, int64_t byteCount) {
+  tier.entries.emplace_front(key, std::move(value));
+  tier.key2Entries[key] = tier.entries.begin();
+  tier.byteCount += byteCount;
+}
+
+template<typename TTier, typename TIterator>
+void touch(TTier& tier, TIterator it) {
+  tier.entries.splice(tier.entries.begin(), tier.entries, it);
+}
+
+bool writeContent(const std::string& path, const std::string& content) {
+  auto fout = std::ofstream(path, std::ios::binary);
+  fout.write(content.data(), std::streamsize(content.size()));
+  return bool(fout);
+}
+
+}  // anonymous
+
+SnapshotKey SnapshotKey::make(int number, SnapshotType type, ScreenParameters parameters) {
+  auto width = int(std::lround(parameters.size.width));
+  auto height = int(std::lround(parameters.size.height));
+  return SnapshotKey{number, width, height, parameters.resolution, type};
+}
+
+size_t SnapshotCache::KeyHash::operator()(const SnapshotKey& key) const {
+  auto hash = size_t(key.number);
+  hash = hash * 31U + size_t(key.width);
+  hash = hash * 31U + size_t(key.height);
+  hash = hash * 31U + size_t(key.resolution);
+  return hash * 31U + size_t(key.type);
+}
+
+bool SnapshotCache::KeyEqual::operator()(const SnapshotKey& a, const SnapshotKey& b) const {
+  return a.number == b.number && a.width == b.width && a.height == b.height
+         && a.resolution == b.resolution && a.type == b.type;
+}
+
+Ptr<SnapshotCache> SnapshotCache::getInstance(const std::string& directory) {
+  std::lock_guard<std::mutex> lock(instanceMutex);
+  auto& instances = getInstances();
+  for (auto it = instances.begin(); it != instances.end(); ++it) {
+    if (it->first == directory) {
+      instances.splice(instances.begin(), instances, it);
+      return it->second;
+    }
+  }
+  auto cache = makePtr<SnapshotCache>(MAX_MEMORY_BYTE_COUNT, MAX_DISK_BYTE_COUNT);
+  instances.emplace_front(directory, cache);
+  if (instances.size() > MAX_INSTANCE_COUNT) {
+    instances.pop_back();
+  }
+  return cache;
+}
+
+void SnapshotCache::close(const std::string& directory) {
+  std::lock_guard<std::mutex> lock(instanceMutex);
+  getInstances().remove_if([&](const InstanceList::value_type& instance) {
+    return instance.first == directory;
+  });
+}
+
+SnapshotCache::SnapshotCache(int64_t maxMemoryByteCount, int64_t maxDiskByteCount)
+  : maxMemoryByteCount(maxMemoryByteCount), maxDiskByteCount(maxDiskByteCount) {}
+
+bool SnapshotCache::restore(const SnapshotKey& key, const std::string& path) {
+  auto content = Ptr<std::string>();
+  auto isDiskHit = false;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto memoryIt = memoryTier.key2Entries.find(key);
+    if (memoryIt != memoryTier.key2Entries.end()) {
+      content = memoryIt->second->second;
+      touch(memoryTier, memoryIt->second);
+      statistics.memoryHitCount++;
+    } else {
+      auto diskIt = diskTier.key2Entries.find(key);
+      if (diskIt == diskTier.key2Entries.end()) {
+        statistics.missCount++;
+        return false;
+      }
+      // Note: the file is read under the lock, so the entry cannot be evicted meanwhile
+      auto& entry = diskIt->second->second;
+      content = makePtr<std::string>(readWholeFile(entry.path));
+      if (content->empty()) {
+        // Note: the file has been removed by the IDE
+        diskTier.byteCount -= entry.byteCount;
+        diskTier.entries.erase(diskIt->second);
+        diskTier.key2Entries.erase(diskIt);
+        statistics.missCount++;
+        return false;
+      }
+      touch(diskTier, diskIt->second);
+      statistics.diskHitCount++;
+      isDiskHit = true;
+    }
+  }
+  if (!writeContent(path, *content)) {
+    return false;
+  }
+  std::lock_guard<std::mutex> lock(mutex);
+  if (isDiskHit) {
+    putInMemory(key, content);
+  }
+  // Note: the newest file is the least likely to be removed by the IDE
+  putOnDisk(key, path, int64_t(content->size()));
+  evictIfNecessary();
+  return true;
+}
+
+void SnapshotCache::put(const SnapshotKey& key, const std::string& path) {
+  auto content = makePtr<std::string>(readWholeFile(path));
+  if (content->empty()) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(mutex);
+  putInMemory(key, content);
+  putOnDisk(key, path, int64_t(content->size()));
+  evictIfNecessary();
+}
+
+void SnapshotCache::clear() {
+  std::lock_guard<std::mutex> lock(mutex);
+  memoryTier = Tier<Ptr<std::string>>();
+  diskTier = Tier<DiskEntry>();
+}
+
+SnapshotCacheStatistics SnapshotCache::getStatistics() {
+  std::lock_guard<std::mutex> lock(mutex);
+  auto result = statistics;
+  result.memoryEntryCount = int64_t(memoryTier.entries.size());
+  result.memoryByteCount = memoryTier.byteCount;
+  result.diskEntryCount = int64_t(diskTier.entries.size());
+  result.diskByteCount = diskTier.byteCount;
+  return result;
+}
+
+void SnapshotCache::putInMemory(const SnapshotKey& key, const Ptr<std::string>& content) {
+  auto byteCount = int64_t(content->size());
+  if (byteCount > maxMemoryByteCount) {
+    return;
+  }
+  auto it = memoryTier.key2Entries.find(key);
+  if (it != memoryTier.key2Entries.end()) {
+    memoryTier.byteCount -= int64_t(it->second->second->size());
+    memoryTier.entries.erase(it->second);
+    memoryTier.key2Entries.erase(it);
+  }
+  putInto(memoryTier, key, content, byteCount);
+}
+
+void SnapshotCache::putOnDisk(const SnapshotKey& key, const std::string& path, int64_t byteCount) {
+  auto it = diskTier.key2Entries.find(key);
+  if (it != diskTier.key2Entries.end()) {
+    diskTier.byteCount -= it->second->second.byteCount;
+    diskTier.entries.erase(it->second);
+    diskTier.key2Entries.erase(it);
+  }
+  putInto(diskTier, key, DiskEntry{path, byteCount}, byteCount);
+}
+
+void SnapshotCache::evictIfNecessary() {
+  while (memoryTier.byteCount > maxMemoryByteCount && !memoryTier.entries.empty()) {
+    auto& last = memoryTier.entries.back();
+    memoryTier.byteCount -= int64_t(last.second->size());
+    memoryTier.key2Entries.erase(last.first);
+    memoryTier.entries.pop_back();
+  }
+  while (diskTier.byteCount > maxDiskByteCount && !diskTier.entries.empty()) {
+    auto& last = diskTier.entries.back();
+    diskTier.byteCount -= last.second.byteCount;
+    diskTier.key2Entries.erase(last.first);
+    diskTier.entries.pop_back();
+  }
+}
+
+}  // graphics
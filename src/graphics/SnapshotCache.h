@@ -0,0 +1,118 @@
+//  Rkernel is an execution kernel for R interpreter
+//  Copyright (C) 2019 JetBrains s.r.o.
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+
+#ifndef RWRAPPER_SNAPSHOTCACHE_H
+#define RWRAPPER_SNAPSHOTCACHE_H
+
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "Ptr.h"
+#include "ScreenParameters.h"
+#include "SnapshotType.h"
+
+namespace graphics {
+
+struct SnapshotKey {
+  int number;
+  int width;  // Note: in pixels, rounded
+  int height;
+  int resolution;
+  SnapshotType type;
+
+  static SnapshotKey make(int number, SnapshotType type, ScreenParameters parameters);
+};
+
+struct SnapshotCacheStatistics {
+  int64_t memoryHitCount = 0;
+  int64_t diskHitCount = 0;
+  int64_t missCount = 0;
+  int64_t memoryEntryCount = 0;
+  int64_t memoryByteCount = 0;
+  int64_t diskEntryCount = 0;
+  int64_t diskByteCount = 0;
+};
+
+/**
+ * Size-bounded LRU cache of rendered snapshots for a snapshot directory.
+ * A plot with a specific number never changes after it has been dumped, so an image
+ * rendered for the same number, type, size and resolution can be reused instead of a replay.
+ * The memory tier keeps contents of recently rendered PNGs, the disk tier keeps paths
+ * of snapshot files rendered previously. On hit, the cached image is written to a new path
+ * (that is, a new snapshot version) exactly like a replay would do.
+ * **Note:** snapshot files belong to the IDE, so the cache never removes them from disk.
+ * It's thread-safe and doesn't depend on R, so it can be used by gRPC threads as well.
+ * Only a few caches are kept alive at once: `getInstance()` drops the least recently used one
+ */
+class SnapshotCache {
+public:
+  static Ptr<SnapshotCache> getInstance(const std::string& directory);
+  static void close(const std::string& directory);
+
+  SnapshotCache(int64_t maxMemoryByteCount, int64_t maxDiskByteCount);
+
+  SnapshotCache(const SnapshotCache&) = delete;
+  SnapshotCache& operator=(const SnapshotCache&) = delete;
+
+  // Write a cached image for `key` to `path`. Returns `false` on a miss
+  bool restore(const SnapshotKey& key, const std::string& path);
+  void put(const SnapshotKey& key, const std::string& path);
+  void clear();
+  SnapshotCacheStatistics getStatistics();
+
+private:
+  struct KeyHash {
+    size_t operator()(const SnapshotKey& key) const;
+  };
+
+  struct KeyEqual {
+    bool operator()(const SnapshotKey& a, const SnapshotKey& b) const;
+  };
+
+  template<typename TValue>
+  struct Tier {
+    using Entry = std::pair<SnapshotKey, TValue>;
+
+    std::list<Entry> entries;  // Note: the most recently used ones go first
+    std::unordered_map<SnapshotKey, typename std::list<Entry>::iterator, KeyHash, KeyEqual> key2Entries;
+    int64_t byteCount = 0;
+  };
+
+  struct DiskEntry {
+    std::string path;
+    int64_t byteCount;
+  };
+
+  std::mutex mutex;
+  int64_t maxMemoryByteCount;
+  int64_t maxDiskByteCount;
+  Tier<Ptr<std::string>> memoryTier;
+  Tier<DiskEntry> diskTier;
+  SnapshotCacheStatistics statistics;
+
+  void putInMemory(const SnapshotKey& key, const Ptr<std::string>& content);
+  void putOnDisk(const SnapshotKey& key, const std::string& path, int64_t byteCount);
+  void evictIfNecessary();
+};
+
+}  // graphics
+
+#endif //RWRAPPER_SNAPSHOTCACHE_H
@@ -0,0 +1,380 @@
+//  Rkernel is an execution kernel for R interpreter
+//  Copyright (C) 2019 JetBrains s.r.o.
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#include "SnapshotStore.h"
+
+#include <cstring>
+#include <iostream>
+
+#include <zlib.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace graphics {
+
+namespace {
+
+const auto INDEX_FILE_NAME = "recorded.index";
+const auto BLOB_FILE_NAME = "recorded.blob";
+const auto RECORD_SIZE = sizeof(int32_t) + 3 * sizeof(uint64_t);
+
+template<typename T>
+void writeValue(std::ostream& out, T value) {
+  out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template<typename T>
+bool readValue(std::istream& in, T& value) {
+  return bool(in.read(reinterpret_cast<char*>(&value), sizeof(T)));
+}
+
+uint64_t getFileSize(const std::string& path) {
+  auto fin = std::ifstream(path, std::ios::binary | std::ios::ate);
+  return fin ? uint64_t(fin.tellg()) : 0U;
+}
+
+bool compress(const std::string& data, std::string& compressed) {
+  auto compressedSize = compressBound(uLong(data.size()));
+  compressed.resize(compressedSize);
+  auto source = reinterpret_cast<const Bytef*>(data.data());
+  auto destination = reinterpret_cast<Bytef*>(&compressed[0]);
+  if (compress2(destination, &compressedSize, source, uLong(data.size()), Z_BEST_SPEED) != Z_OK) {
+    return false;
+  }
+  compressed.resize(compressedSize);
+  return true;
+}
+
+bool decompress(const char* compressed, uint64_t compressedSize, uint64_t rawSize, std::string& data) {
+  data.resize(rawSize);
+  auto actualSize = uLongf(rawSize);
+  auto source = reinterpret_cast<const Bytef*>(compressed);
+  auto destination = reinterpret_cast<Bytef*>(&data[0]);
+  return uncompress(destination, &actualSize, source, uLong(compressedSize)) == Z_OK && actualSize == rawSize;
+}
+
+struct SerializationContext {
+  SEXP plot;
+  std::string* data;
+};
+
+void writeChar(R_outpstream_t stream, int c) {
+  static_cast<std::string*>(stream->data)->push_back(char(c));
+}
+
+void writeBytes(R_outpstream_t stream, void* buffer, int length) {
+  static_cast<std::string*>(stream->data)->append(static_cast<const char*>(buffer), length);
+}
+
+void serialize(void* data) {
+  auto context = static_cast<SerializationContext*>(data);
+  auto stream = R_outpstream_st();
+  R_InitOutPStream(&stream, context->data, R_pstream_xdr_format, 0, writeChar, writeBytes, nullptr, R_NilValue);
+  R_Serialize(context->plot, &stream);
+}
+
+struct DeserializationContext {
+  const std::string* data;
+  size_t position;
+  SEXP plot;
+};
+
+int readChar(R_inpstream_t stream) {
+  auto context = static_cast<DeserializationContext*>(stream->data);
+  if (context->position >= context->data->size()) {
+    Rf_error("unexpected end of a recorded plot");
+  }
+  return static_cast<unsigned char>((*context->data)[context->position++]);
+}
+
+void readBytes(R_inpstream_t stream, void* buffer, int length) {
+  auto context = static_cast<DeserializationContext*>(stream->data);
+  if (context->position + length > context->data->size()) {
+    Rf_error("unexpected end of a recorded plot");
+  }
+  memcpy(buffer, context->data->data() + context->position, length);
+  context->position += length;
+}
+
+void deserialize(void* data) {
+  auto context = static_cast<DeserializationContext*>(data);
+  auto stream = R_inpstream_st();
+  R_InitInPStream(&stream, context, R_pstream_any_format, readChar, readBytes, nullptr, R_NilValue);
+  context->plot = R_Unserialize(&stream);
+}
+
+std::unordered_map<std::string, Ptr<SnapshotStore>>& getInstances() {
+  static auto instances = std::unordered_map<std::string, Ptr<SnapshotStore>>();
+  return instances;
+}
+
+}  // anonymous
+
+Ptr<SnapshotStore> SnapshotStore::getInstance(const std::string& directory) {
+  auto& instances = getInstances();
+  auto it = instances.find(directory);
+  if (it != instances.end()) {
+    return it->second;
+  }
+  auto store = makePtr<SnapshotStore>(directory);
+  instances[directory] = store;
+  return store;
+}
+
+void SnapshotStore::close(const std::string& directory) {
+  // Note: the destructor will wait for all pending writes
+  getInstances().erase(directory);
+}
+
+SnapshotStore::SnapshotStore(const std::string& directory)
+  : indexPath(directory + "/" + INDEX_FILE_NAME), blobPath(directory + "/" + BLOB_FILE_NAME)
+{
+  loadIndex();
+  writer = std::thread([this] {
+    runWriter();
+  });
+}
+
+SnapshotStore::~SnapshotStore() {
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    isClosing = true;
+    condition.notify_all();
+  }
+  writer.join();
+  unmap();
+}
+
+void SnapshotStore::loadIndex() {
+  blobSize = getFileSize(blobPath);
+  auto fin = std::ifstream(indexPath, std::ios::binary);
+  auto number = int32_t();
+  auto entry = Entry();
+  indexSize = 0U;
+  while (readValue(fin, number) && readValue(fin, entry.offset)
+         && readValue(fin, entry.compressedSize) && readValue(fin, entry.rawSize))
+  {
+    indexSize += RECORD_SIZE;
+    // Note: skip entries which refer beyond the blob (say, the kernel was killed in the middle of a write)
+    if (entry.offset + entry.compressedSize <= blobSize) {
+      entries[number] = entry;
+    }
+  }
+}
+
+void SnapshotStore::truncateIndex(uint64_t size) {
+  auto prefix = std::string(size, '\0');
+  if (size > 0U) {
+    auto fin = std::ifstream(indexPath, std::ios::binary);
+    if (!fin.read(&prefix[0], std::streamsize(size))) {
+      std::cerr << "Cannot read " << indexPath << "\n";
+      return;
+    }
+  }
+  auto fout = std::ofstream(indexPath, std::ios::binary | std::ios::trunc);
+  fout.write(prefix.data(), std::streamsize(size));
+  if (!fout) {
+    std::cerr << "Cannot truncate " << indexPath << "\n";
+  }
+}
+
+bool SnapshotStore::put(int number, SEXP plot) {
+  auto data = makePtr<std::string>();
+  auto context = SerializationContext{plot, data.get()};
+  if (!R_ToplevelExec(serialize, &context)) {
+    std::cerr << "Cannot serialize recorded plot #" << number << ". Ignored\n";
+    return false;
+  }
+  std::unique_lock<std::mutex> lock(mutex);
+  number2PendingData[number] = data;
+  tasks.push_back(Task{number, data});
+  condition.notify_all();
+  return true;
+}
+
+bool SnapshotStore::contains(int number) {
+  std::unique_lock<std::mutex> lock(mutex);
+  return number2PendingData.find(number) != number2PendingData.end() || entries.find(number) != entries.end();
+}
+
+SEXP SnapshotStore::get(int number, ScopeProtector* protector) {
+  auto data = Ptr<std::string>();
+  auto entry = Entry();
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    auto pendingIt = number2PendingData.find(number);
+    if (pendingIt != number2PendingData.end()) {
+      data = pendingIt->second;
+    } else {
+      auto entryIt = entries.find(number);
+      if (entryIt == entries.end()) {
+        return R_NilValue;
+      }
+      entry = entryIt->second;
+    }
+  }
+  if (!data) {
+    data = makePtr<std::string>();
+    if (!read(entry, *data)) {
+      std::cerr << "Cannot read recorded plot #" << number << " from " << blobPath << "\n";
+      return R_NilValue;
+    }
+  }
+  auto context = DeserializationContext{data.get(), 0U, R_NilValue};
+  if (!R_ToplevelExec(deserialize, &context)) {
+    std::cerr << "Cannot deserialize recorded plot #" << number << "\n";
+    return R_NilValue;
+  }
+  protector->add(context.plot);
+  return context.plot;
+}
+
+void SnapshotStore::runWriter() {
+  while (true) {
+    auto task = Task();
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      condition.wait(lock, [this] {
+        return isClosing || !tasks.empty();
+      });
+      if (tasks.empty()) {
+        return;
+      }
+      task = std::move(tasks.front());
+      tasks.pop_front();
+    }
+    auto entry = Entry();
+    auto isWritten = append(task.number, *task.data, entry);
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      // Note: if a write has failed, the plot will be still available from memory within this session
+      if (isWritten) {
+        entries[task.number] = entry;
+        auto pendingIt = number2PendingData.find(task.number);
+        if (pendingIt != number2PendingData.end() && pendingIt->second == task.data) {
+          number2PendingData.erase(pendingIt);
+        }
+      }
+    }
+  }
+}
+
+bool SnapshotStore::append(int number, const std::string& data, Entry& entry) {
+  auto compressed = std::string();
+  if (!compress(data, compressed)) {
+    std::cerr << "Cannot compress recorded plot #" << number << "\n";
+    return false;
+  }
+  if (!blobOut.is_open()) {
+    // Note: a torn trailing record must be cut off, otherwise all the records appended after it
+    // will be misaligned and unreadable
+    if (getFileSize(indexPath) > indexSize) {
+      truncateIndex(indexSize);
+    }
+    blobOut.open(blobPath, std::ios::binary | std::ios::app);
+    indexOut.open(indexPath, std::ios::binary | std::ios::app);
+  }
+  entry = Entry{blobSize, compressed.size(), data.size()};
+
+  // Note: the blob is flushed first so an index entry never refers to missing data
+  blobOut.write(compressed.data(), compressed.size());
+  blobOut.flush();
+  if (!blobOut) {
+    std::cerr << "Cannot write recorded plot #" << number << " to " << blobPath << "\n";
+    blobOut.close();
+    indexOut.close();
+    blobSize = getFileSize(blobPath);
+    return false;
+  }
+  blobSize += compressed.size();
+  writeValue(indexOut, int32_t(number));
+  writeValue(indexOut, entry.offset);
+  writeValue(indexOut, entry.compressedSize);
+  writeValue(indexOut, entry.rawSize);
+  indexOut.flush();
+  if (!indexOut) {
+    // Note: the record might be torn, so it will be cut off when the files are reopened
+    std::cerr << "Cannot write index of recorded plot #" << number << " to " << indexPath << "\n";
+    blobOut.close();
+    indexOut.close();
+    return false;
+  }
+  indexSize += RECORD_SIZE;
+  return true;
+}
+
+bool SnapshotStore::read(const Entry& entry, std::string& data) {
+  auto end = entry.offset + entry.compressedSize;
+  if (ensureMapped(end)) {
+    return decompress(mappedData + entry.offset, entry.compressedSize, entry.rawSize, data);
+  }
+  auto fin = std::ifstream(blobPath, std::ios::binary);
+  auto compressed = std::string(entry.compressedSize, '\0');
+  if (!fin.seekg(std::streamoff(entry.offset)) || !fin.read(&compressed[0], compressed.size())) {
+    return false;
+  }
+  return decompress(compressed.data(), entry.compressedSize, entry.rawSize, data);
+}
+
+#ifndef _WIN32
+bool SnapshotStore::ensureMapped(uint64_t size) {
+  if (mappedData && mappedSize >= size) {
+    return true;
+  }
+  // Note: the blob only grows, so the whole file is remapped in order to cover all the entries written so far
+  unmap();
+  auto fileSize = getFileSize(blobPath);
+  if (fileSize < size || fileSize == 0) {
+    return false;
+  }
+  auto descriptor = open(blobPath.c_str(), O_RDONLY);
+  if (descriptor < 0) {
+    return false;
+  }
+  auto address = mmap(nullptr, fileSize, PROT_READ, MAP_SHARED, descriptor, 0);
+  ::close(descriptor);
+  if (address == MAP_FAILED) {
+    return false;
+  }
+  mappedData = static_cast<const char*>(address);
+  mappedSize = fileSize;
+  return true;
+}
+
+void SnapshotStore::unmap() {
+  if (mappedData) {
+    munmap(const_cast<char*>(mappedData), mappedSize);
+    mappedData = nullptr;
+    mappedSize = 0;
+  }
+}
+#else
+// Note: the blob is being appended to while it's read, so it's not mapped on Windows
+// where a mapped file cannot be extended. The reading falls back to a plain file stream
+bool SnapshotStore::ensureMapped(uint64_t size) {
+  return false;
+}
+
+void SnapshotStore::unmap() {
+}
+#endif
+
+}  // graphics
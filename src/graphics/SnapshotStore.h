@@ -0,0 +1,107 @@
+//  Rkernel is an execution kernel for R interpreter
+//  Copyright (C) 2019 JetBrains s.r.o.
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#ifndef RWRAPPER_SNAPSHOTSTORE_H
+#define RWRAPPER_SNAPSHOTSTORE_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+#include <Rinternals.h>
+
+#include "Ptr.h"
+#include "ScopeProtector.h"
+
+namespace graphics {
+
+/**
+ * Kernel-managed storage of recorded plots for a snapshot directory.
+ * Plots are serialized natively on the main thread, then compressed and appended
+ * to a blob file by a background writer. An index file maps snapshot numbers to blob ranges.
+ * Both files are append-only so the latest index entry for a number wins.
+ * The index is loaded once on construction, so stores of directories which are not being
+ * written by this kernel should be closed right after use in order to see fresh data next time.
+ * A torn trailing index record is ignored on load and cut off only before the first write,
+ * so the directories of other sessions (which are only read) are never modified.
+ * **Note:** all methods but the constructor must be called from the main R thread
+ */
+class SnapshotStore {
+public:
+  static Ptr<SnapshotStore> getInstance(const std::string& directory);
+  static void close(const std::string& directory);
+
+  explicit SnapshotStore(const std::string& directory);
+  ~SnapshotStore();
+
+  SnapshotStore(const SnapshotStore&) = delete;
+  SnapshotStore& operator=(const SnapshotStore&) = delete;
+
+  bool put(int number, SEXP plot);
+  bool contains(int number);
+  SEXP get(int number, ScopeProtector* protector);  // Note: returns `R_NilValue` if a plot cannot be restored
+
+private:
+  struct Entry {
+    uint64_t offset;
+    uint64_t compressedSize;
+    uint64_t rawSize;
+  };
+
+  struct Task {
+    int number;
+    Ptr<std::string> data;
+  };
+
+  std::string indexPath;
+  std::string blobPath;
+
+  std::mutex mutex;
+  std::condition_variable condition;
+  std::unordered_map<int, Entry> entries;
+  std::unordered_map<int, Ptr<std::string>> number2PendingData;  // Serialized but not written yet
+  std::deque<Task> tasks;
+  bool isClosing = false;
+  std::thread writer;
+
+  // Note: the fields below are accessed by the writer thread only
+  std::ofstream indexOut;
+  std::ofstream blobOut;
+  uint64_t blobSize = 0;
+  uint64_t indexSize = 0;  // Note: excluding a torn trailing record if any
+
+  // Note: the fields below are accessed by the main thread only
+  const char* mappedData = nullptr;
+  uint64_t mappedSize = 0;
+
+  void loadIndex();
+  void truncateIndex(uint64_t size);
+  void runWriter();
+  bool append(int number, const std::string& data, Entry& entry);
+  bool read(const Entry& entry, std::string& data);
+  bool ensureMapped(uint64_t size);
+  void unmap();
+};
+
+}  // graphics
+
+#endif //RWRAPPER_SNAPSHOTSTORE_H
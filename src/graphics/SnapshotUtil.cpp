@@ -17,7 +17,15 @@
 
 #include "SnapshotUtil.h"
 
+#include <algorithm>
 #include <sstream>
+#include <vector>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <dirent.h>
+#endif
 
 namespace graphics {
 
@@ -28,6 +36,7 @@ const auto DUMMY_SNAPSHOT_NAME = "snapshot_0.png";
 const auto RECORDED_SNAPSHOT_PREFIX = "recordedSnapshot";
 const auto RECORD_COMMAND_NAME = "grDevices::recordPlot";
 const auto REPLAY_COMMAND_NAME = "grDevices::replayPlot";
+const auto REPLAY_RECORDED_FUNCTION_NAME = ".jetbrains$replayRecordedPlot";
 
 std::string makeRecordCommand(const std::string& receiverName, bool hasGgPlot) {
   auto sout = std::ostringstream();
@@ -48,6 +57,30 @@ std::string makeLoadAndReplayCommand(const std::string& filePath) {
   return sout.str();
 }
 
+std::vector<std::string> listFileNames(const std::string& directory) {
+  auto names = std::vector<std::string>();
+#ifdef _WIN32
+  auto pattern = directory + "/*";
+  auto info = _finddata_t();
+  auto handle = _findfirst(pattern.c_str(), &info);
+  if (handle != -1) {
+    do {
+      names.emplace_back(info.name);
+    } while (_findnext(handle, &info) == 0);
+    _findclose(handle);
+  }
+#else
+  auto dir = opendir(directory.c_str());
+  if (dir) {
+    while (auto entry = readdir(dir)) {
+      names.emplace_back(entry->d_name);
+    }
+    closedir(dir);
+  }
+#endif
+  return names;
+}
+
 }  // anonymous
 
 const char* SnapshotUtil::getDummySnapshotName() {
@@ -92,18 +125,29 @@ std::string SnapshotUtil::makeReplayFileCommand(const std::string &directory, in
   return makeLoadAndReplayCommand(filePath);
 }
 
-std::string SnapshotUtil::makeSaveVariableCommand(const std::string &directory, int deviceNumber, int snapshotNumber) {
-  auto variableName = makeVariableName(deviceNumber, snapshotNumber);
-  auto filePath = makeRecordedFilePath(directory, snapshotNumber);
+std::string SnapshotUtil::makeRemoveVariablesCommand(int deviceNumber, int from, int to) {
   auto sout = std::ostringstream();
-  sout << ".jetbrains$saveRecordedPlotToFile(" << variableName << ", '" << filePath << "')";
+  sout << ".jetbrains$dropRecordedSnapshots(" << deviceNumber << ", " << from << ", " << to << ")";
   return sout.str();
 }
 
-std::string SnapshotUtil::makeRemoveVariablesCommand(int deviceNumber, int from, int to) {
+const char* SnapshotUtil::getReplayRecordedFunctionName() {
+  return REPLAY_RECORDED_FUNCTION_NAME;
+}
+
+std::string SnapshotUtil::findStoredSnapshotName(const std::string& directory, int snapshotNumber) {
+  // Note: trailing underscore will cut off remaining digits if any
   auto sout = std::ostringstream();
-  sout << ".jetbrains$dropRecordedSnapshots(" << deviceNumber << ", " << from << ", " << to << ")";
-  return sout.str();
+  sout << "snapshot_" << toString(SnapshotType::NORMAL) << "_" << snapshotNumber << "_";
+  auto prefix = sout.str();
+  auto names = listFileNames(directory);
+  std::sort(names.begin(), names.end());
+  for (const auto& name : names) {
+    if (name.compare(0, prefix.size(), prefix) == 0) {
+      return name;
+    }
+  }
+  return "";
 }
 
 }  // graphics
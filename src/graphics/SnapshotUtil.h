@@ -30,12 +30,15 @@ public:
   static std::string makeSnapshotName(int number, int version, int resolution);
   static std::string makeSnapshotName(SnapshotType type, int number, int version, int resolution);
   static std::string makeRecordedFilePath(const std::string &directory, int snapshotNumber);
-  static std::string makeSaveVariableCommand(const std::string& directory, int deviceNumber, int snapshotNumber);
   static std::string makeReplayFileCommand(const std::string& directory, int snapshotNumber);
   static std::string makeVariableName(int deviceNumber, int snapshotNumber);
   static std::string makeRecordVariableCommand(int deviceNumber, int snapshotNumber, bool hasGgPlot);
   static std::string makeReplayVariableCommand(int deviceNumber, int snapshotNumber);
   static std::string makeRemoveVariablesCommand(int deviceNumber, int from, int to);
+  static const char* getReplayRecordedFunctionName();
+
+  // Note: returns an empty string if there is no normal snapshot with the specified number
+  static std::string findStoredSnapshotName(const std::string& directory, int snapshotNumber);
 };
 
 }  // graphics
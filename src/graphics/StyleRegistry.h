@@ -0,0 +1,145 @@
+#ifndef RWRAPPER_STYLEREGISTRY_H
+#define RWRAPPER_STYLEREGISTRY_H
+
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+#include <vector>
+
+#include "Color.h"
+#include "Font.h"
+#include "Stroke.h"
+
+namespace graphics {
+
+/**
+ * Hash-indexed interning tables for fonts, strokes and colors of a plot.
+ * Indices are never reassigned, so a registry which is kept between
+ * rescales of the same plot produces stable style indices for all its versions.
+ * **Note:** fonts and strokes are compared with `isClose()`.
+ * Their real-valued fields are quantized with `EPSILON` step for hashing
+ * and the neighbour buckets are probed as well, so two close values
+ * will be found even if they are quantized differently
+ */
+class StyleRegistry {
+private:
+  std::vector<Font> fonts;
+  std::vector<Stroke> strokes;
+  std::vector<Color> colors;
+
+  std::unordered_map<std::uint64_t, std::vector<int>> hash2FontIndices;
+  std::unordered_map<std::uint64_t, std::vector<int>> hash2StrokeIndices;
+  std::unordered_map<int, int> color2Indices;  // The key is a `Color::value`
+
+  static std::int64_t quantize(double value) {
+    return std::int64_t(std::floor(value / EPSILON));
+  }
+
+  static std::uint64_t combine(std::uint64_t hash, std::uint64_t value) {
+    return hash ^ (value + 0x9e3779b97f4a7c15ULL + (hash << 6U) + (hash >> 2U));
+  }
+
+  static std::uint64_t hashOf(const Font& font, std::int64_t quantizedSize) {
+    auto hash = std::uint64_t(std::hash<std::string>()(font.name));
+    hash = combine(hash, std::uint64_t(font.style));
+    return combine(hash, std::uint64_t(quantizedSize));
+  }
+
+  static std::uint64_t hashOf(const Stroke& stroke, std::int64_t quantizedWidth, std::int64_t quantizedMiterLimit) {
+    auto hash = std::uint64_t(stroke.cap);
+    hash = combine(hash, std::uint64_t(stroke.join));
+    hash = combine(hash, std::uint64_t(stroke.pattern));
+    hash = combine(hash, std::uint64_t(quantizedWidth));
+    return combine(hash, std::uint64_t(quantizedMiterLimit));
+  }
+
+  template<typename TObject>
+  static int findIndex(const TObject& object, std::uint64_t hash, const std::vector<TObject>& objects,
+                       const std::unordered_map<std::uint64_t, std::vector<int>>& hash2Indices)
+  {
+    auto it = hash2Indices.find(hash);
+    if (it != hash2Indices.end()) {
+      for (auto index : it->second) {
+        if (isClose(object, objects[index])) {
+          return index;
+        }
+      }
+    }
+    return -1;
+  }
+
+  template<typename TObject>
+  static int registerIndex(const TObject& object, std::uint64_t hash, std::vector<TObject>& objects,
+                           std::unordered_map<std::uint64_t, std::vector<int>>& hash2Indices)
+  {
+    auto index = int(objects.size());
+    objects.push_back(object);
+    hash2Indices[hash].push_back(index);
+    return index;
+  }
+
+public:
+  StyleRegistry() {
+    getOrRegisterColorIndex(Color::getBlack());
+    getOrRegisterColorIndex(Color::getWhite());
+    getOrRegisterFontIndex(Font::getDefault());
+  }
+
+  int getOrRegisterFontIndex(const Font& font) {
+    auto size = quantize(font.size);
+    for (auto delta = -1; delta <= 1; delta++) {
+      auto index = findIndex(font, hashOf(font, size + delta), fonts, hash2FontIndices);
+      if (index != -1) {
+        return index;
+      }
+    }
+    return registerIndex(font, hashOf(font, size), fonts, hash2FontIndices);
+  }
+
+  int getOrRegisterStrokeIndex(const Stroke& stroke) {
+    auto width = quantize(stroke.width);
+    auto miterLimit = quantize(stroke.miterLimit);
+    for (auto widthDelta = -1; widthDelta <= 1; widthDelta++) {
+      for (auto miterLimitDelta = -1; miterLimitDelta <= 1; miterLimitDelta++) {
+        auto hash = hashOf(stroke, width + widthDelta, miterLimit + miterLimitDelta);
+        auto index = findIndex(stroke, hash, strokes, hash2StrokeIndices);
+        if (index != -1) {
+          return index;
+        }
+      }
+    }
+    return registerIndex(stroke, hashOf(stroke, width, miterLimit), strokes, hash2StrokeIndices);
+  }
+
+  int getOrRegisterColorIndex(Color color) {
+    if (color.isTransparent()) {
+      return -1;
+    }
+    auto it = color2Indices.find(color.value);
+    if (it == color2Indices.end()) {
+      auto index = int(colors.size());
+      colors.push_back(color);
+      color2Indices[color.value] = index;
+      return index;
+    } else {
+      return it->second;
+    }
+  }
+
+  const std::vector<Font>& getFonts() const {
+    return fonts;
+  }
+
+  const std::vector<Stroke>& getStrokes() const {
+    return strokes;
+  }
+
+  const std::vector<Color>& getColors() const {
+    return colors;
+  }
+};
+
+}  // graphics
+
+#endif //RWRAPPER_STYLEREGISTRY_H
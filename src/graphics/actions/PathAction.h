@@ -5,6 +5,7 @@
 #include <sstream>
 
 #include "Action.h"
+#include "../Arena.h"
 #include "../Point.h"
 #include "../Color.h"
 #include "../Stroke.h"
@@ -14,14 +15,14 @@ namespace graphics {
 
 class PathAction : public Action {
 private:
-  std::vector<std::vector<Point>> subPaths;
+  ArenaVector<ArenaVector<Point>> subPaths;  // inches
   bool winding;
   Stroke stroke;
   Color color;
   Color fill;
 
 public:
-  PathAction(std::vector<std::vector<Point>> subPaths, bool winding, Stroke stroke, Color color, Color fill)
+  PathAction(ArenaVector<ArenaVector<Point>> subPaths, bool winding, Stroke stroke, Color color, Color fill)
     : subPaths(std::move(subPaths)), winding(winding), stroke(stroke), color(color), fill(fill) {}
 
   ActionKind getKind() const override {
@@ -30,7 +31,7 @@ public:
 
   std::string toString() const override {
     auto sout = std::ostringstream();
-    auto mapper = [](const std::vector<Point>& points) {
+    auto mapper = [](const ArenaVector<Point>& points) {
       return joinToString(points, [](Point point) { return point; }, "[", "]");
     };
     sout << "PathAction(subPaths: " << joinToString(subPaths, mapper, "[", "]") << ", winding: " << winding
@@ -38,7 +39,7 @@ public:
     return sout.str();
   }
 
-  const std::vector<std::vector<Point>>& getSubPaths() const {
+  const ArenaVector<ArenaVector<Point>>& getSubPaths() const {
     return subPaths;
   }
 
@@ -5,6 +5,7 @@
 #include <sstream>
 
 #include "Action.h"
+#include "../Arena.h"
 #include "../Point.h"
 #include "../Color.h"
 #include "../Stroke.h"
@@ -14,13 +15,13 @@ namespace graphics {
 
 class PolygonAction : public Action {
 private:
-  std::vector<Point> points;  // inches
+  ArenaVector<Point> points;  // inches
   Stroke stroke;
   Color color;
   Color fill;
 
 public:
-  PolygonAction(std::vector<Point> points, Stroke stroke, Color color, Color fill)
+  PolygonAction(ArenaVector<Point> points, Stroke stroke, Color color, Color fill)
     : points(std::move(points)), stroke(stroke), color(color), fill(fill) {}
 
   ActionKind getKind() const override {
@@ -34,7 +35,7 @@ public:
     return sout.str();
   }
 
-  const std::vector<Point>& getPoints() const {
+  const ArenaVector<Point>& getPoints() const {
     return points;
   }
 
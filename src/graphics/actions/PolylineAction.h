@@ -5,6 +5,7 @@
 #include <sstream>
 
 #include "Action.h"
+#include "../Arena.h"
 #include "../Point.h"
 #include "../Color.h"
 #include "../Stroke.h"
@@ -14,12 +15,12 @@ namespace graphics {
 
 class PolylineAction : public Action {
 private:
-  std::vector<Point> points;  // inches
+  ArenaVector<Point> points;  // inches
   Stroke stroke;
   Color color;
 
 public:
-  PolylineAction(std::vector<Point> points, Stroke stroke, Color color)
+  PolylineAction(ArenaVector<Point> points, Stroke stroke, Color color)
     : points(std::move(points)), stroke(stroke), color(color) {}
 
   ActionKind getKind() const override {
@@ -32,7 +33,7 @@ public:
     return sout.str();
   }
 
-  const std::vector<Point>& getPoints() const {
+  const ArenaVector<Point>& getPoints() const {
     return points;
   }
 